@@ -5,6 +5,20 @@
 #include <cmath>
 #include <cstring>
 #include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <unordered_map>
+#include <future>
+#include <chrono>
+#include <sstream>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 using namespace std;
 
 //***************************************************************************************************//
@@ -220,476 +234,4409 @@ bool write_image(string filename, const vector<vector<Pixel>>& image)
 
 //
 // YOUR FUNCTION DEFINITIONS HERE
+
+// Image properties read from the BMP and DIB headers
+struct BmpInfo
+{
+    // true if the header describes an image load_image can decode
+    bool valid;
+    long long file_size;
+    int start;
+    int width;
+    int height;
+    int bits_per_pixel;
+    int compression;
+};
+
+// Size of the BMP header plus the smallest DIB header we accept
+const int BMP_PROBE_SIZE = 54;
+
 /*
-    Function that darkens the edges of an image.
+    Function that gets an integer from a byte array.
+    Counterpart of set_bytes() for headers that are already in memory.
+    * @param arr is the array to read from
+    @param offset is the starting index offset
+    @param bytes is the number of bytes to read
+    @return the unsigned integer starting at the given offset
+*/
+unsigned int get_bytes(const unsigned char arr[], int offset, int bytes)
+{
+    unsigned int result = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        result = result | ((unsigned int)arr[offset+i] << (i*8));
+    }
+    return result;
+}
+
+/*
+    Function that gets a 64 bit integer from a byte array.
+    * @param arr is the array to read from
+    @param offset is the starting index offset
+    @param bytes is the number of bytes to read
+    @return the integer starting at the given offset
+*/
+long long get_long_bytes(const unsigned char arr[], int offset, int bytes)
+{
+    long long result = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        result = result | ((long long)arr[offset+i] << (i*8));
+    }
+    return result;
+}
+
+// BMP compression methods
+const int BI_RGB = 0;
+const int BI_RLE8 = 1;
+const int BI_RLE4 = 2;
+const int BI_BITFIELDS = 3;
+
+// End of the red, green and blue masks of a BI_BITFIELDS image, which
+// follow the 40 byte DIB header
+const int BMP_MASKS_END = 66;
+
+/*
+    Function that gets the number of bytes in one padded scan line.
+    * @param width is the width in pixels
+    @param bits_per_pixel is the bits per pixel
+    @return the scan line size including padding to four bytes
+*/
+long long scanline_bytes(long long width, int bits_per_pixel)
+{
+    if (bits_per_pixel >= 8)
+    {
+        // same rule as read_image()
+        long long scanline_size = width * (bits_per_pixel / 8);
+        return scanline_size + (4 - scanline_size % 4) % 4;
+    }
+    return (width * bits_per_pixel + 31) / 32 * 4;
+}
+
+/*
+    Function that gets the number of colors stored in the palette of a
+    1, 4 or 8 bit BMP.
+    * @param header is the start of the file, at least BMP_PROBE_SIZE bytes
+    @param bits is the bits per pixel
+    @return the stored colors, 2^bits if the header leaves it to the default
+*/
+int palette_colors(const unsigned char header[], int bits)
+{
+    int colors = get_bytes(header, 46, 4);
+    if (colors <= 0 || colors > (1 << bits))
+    {
+        colors = 1 << bits;
+    }
+    return colors;
+}
+
+/*
+    Function that checks the BMP and DIB header fields already in memory.
+    Uses the same size and palette rules as read_image() so a valid result
+    means the image can be decoded.
+    32 bit BI_BITFIELDS images with the usual masks store their pixels
+    the same way as 32 bit BI_RGB images, and are reported as BI_RGB.
+    * @param header is the start of the file
+    @param size is the number of bytes in header, at least BMP_PROBE_SIZE
+    @return the image properties and whether they are valid
+*/
+BmpInfo parse_header(const unsigned char header[], size_t size)
+{
+    BmpInfo info = {false, 0, 0, 0, 0, 0, 0};
+    if (header[0] != 'B' || header[1] != 'M')
+    {
+        return info;
+    }
+    info.file_size = get_bytes(header, 2, 4);
+    info.start = get_bytes(header, 10, 4);
+    info.width = get_bytes(header, 18, 4);
+    info.height = get_bytes(header, 22, 4);
+    info.bits_per_pixel = get_bytes(header, 28, 2);
+    info.compression = get_bytes(header, 30, 4);
+
+    // bottom-up images only, palette-indexed, 24 or 32 bit
+    if (info.width <= 0 || info.height <= 0 || info.start < BMP_PROBE_SIZE)
+    {
+        return info;
+    }
+    int bits = info.bits_per_pixel;
+    if (bits != 1 && bits != 4 && bits != 8 && bits != 24 && bits != 32)
+    {
+        return info;
+    }
+    // same rule as read_palette(), the palette ends before the pixel array
+    if (bits <= 8 && 14 + (long long)get_bytes(header, 14, 4) + palette_colors(header, bits) * 4 > info.start)
+    {
+        return info;
+    }
+    // run-length encoded images have no fixed size
+    if (info.compression == BI_RLE8 || info.compression == BI_RLE4)
+    {
+        int rle_bits = info.compression == BI_RLE8 ? 8 : 4;
+        info.valid = bits == rle_bits && info.file_size > info.start;
+        return info;
+    }
+    if (info.compression == BI_BITFIELDS && bits == 32 && info.start >= BMP_MASKS_END && size >= (size_t)BMP_MASKS_END
+        && get_bytes(header, 54, 4) == 0x00FF0000 && get_bytes(header, 58, 4) == 0x0000FF00 && get_bytes(header, 62, 4) == 0x000000FF)
+    {
+        info.compression = BI_RGB;
+    }
+    info.valid = info.compression == BI_RGB
+        && info.file_size == info.start + scanline_bytes(info.width, bits) * info.height;
+    return info;
+}
+
+/*
+    Raw image format, for handing images between processes without a
+    decode. A fixed header is followed by top-down rows, and a file can be
+    mapped into memory and used as it is. All fields are little endian:
+      0  "SRAW"               4  version
+      8  header size, the offset of row 0
+      12 width                16 height
+      20 channels (3 or 4)    24 channel layout
+      28 bits per channel (8)
+      32 row stride (8 bytes) 40 size of all rows (8 bytes)
+      48 reserved, zero
+*/
+const int RAW_HEADER_SIZE = 64;
+const int RAW_VERSION = 1;
+// Rows start on a cache line when the file is mapped
+const int RAW_ALIGNMENT = 64;
+// Channel layouts, in the order the bytes of a pixel are stored
+const int RAW_RGB = 0;
+const int RAW_BGR = 1;
+const int RAW_RGBA = 2;
+const int RAW_BGRA = 3;
+// BmpInfo compression of a raw image
+const int RAW_IMAGE = -1;
+
+// Image properties read from a raw header
+struct RawInfo
+{
+    // true if the header describes an image load_raw_image can read
+    bool valid;
+    int width;
+    int height;
+    int channels;
+    int layout;
+    long long row_stride;
+    long long data_offset;
+};
+
+/*
+    Function that gets the number of bytes in one aligned raw row.
+    * @param width is the width in pixels
+    @param channels is the number of bytes per pixel
+    @return the row size including padding to RAW_ALIGNMENT bytes
+*/
+long long raw_stride(long long width, int channels)
+{
+    return (width * channels + RAW_ALIGNMENT - 1) / RAW_ALIGNMENT * RAW_ALIGNMENT;
+}
+
+/*
+    Function that checks the fields of a raw header already in memory.
+    * @param header is the first RAW_HEADER_SIZE bytes of the file
+    @return the image properties and whether they are valid
+*/
+RawInfo parse_raw_header(const unsigned char header[])
+{
+    RawInfo info = {false, 0, 0, 0, 0, 0, 0};
+    if (memcmp(header, "SRAW", 4) != 0)
+    {
+        return info;
+    }
+    int version = get_bytes(header, 4, 4);
+    info.data_offset = get_bytes(header, 8, 4);
+    info.width = get_bytes(header, 12, 4);
+    info.height = get_bytes(header, 16, 4);
+    info.channels = get_bytes(header, 20, 4);
+    info.layout = get_bytes(header, 24, 4);
+    int bits = get_bytes(header, 28, 4);
+    info.row_stride = get_long_bytes(header, 32, 8);
+    long long data_bytes = get_long_bytes(header, 40, 8);
+
+    bool layout_ok = (info.channels == 3 && (info.layout == RAW_RGB || info.layout == RAW_BGR))
+        || (info.channels == 4 && (info.layout == RAW_RGBA || info.layout == RAW_BGRA));
+    info.valid = version == RAW_VERSION && layout_ok && bits == 8
+        && info.width > 0 && info.height > 0
+        && info.data_offset >= RAW_HEADER_SIZE && info.data_offset % RAW_ALIGNMENT == 0
+        && info.row_stride >= (long long)info.width * info.channels && info.row_stride % RAW_ALIGNMENT == 0
+        && data_bytes == info.row_stride * info.height;
+    return info;
+}
+
+/*
+    Function that reads only the header of a raw image file.
     * @param filename is the location where the file is stored
-    @return a new image with darker edges.
+    @return the image properties and whether they are valid
 */
-vector<vector<Pixel>> proc1(string filename)
+RawInfo probe_raw(string filename)
 {
+    RawInfo info = {false, 0, 0, 0, 0, 0, 0};
+    fstream stream;
+    stream.open(filename, ios::in | ios::binary);
+    if (!stream.is_open())
+    {
+        return info;
+    }
+    unsigned char header[RAW_HEADER_SIZE] = {0};
+    stream.read((char*)header, RAW_HEADER_SIZE);
+    if (stream.gcount() != RAW_HEADER_SIZE)
+    {
+        return info;
+    }
+    info = parse_raw_header(header);
 
-    // Call the read_image function and return its result
-    vector<vector<Pixel>> image = read_image(filename);
-    // Getting the size of the width and heigh pixels
-    int width_pixels = image[0].size();
-    int height_pixels = image.size();
-    // defines a new image withe strucutr pixels and the same size as the orginal image 
-    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
-    /*
-    The nested for loop below 
-    Adds vignette effect to image (dark corners)
-    and scales the colors based on the distance of the pixels from the 
-    center.
-    */
+    // a truncated file cannot be mapped whole
+    stream.seekg(0, ios::end);
+    if (info.valid && stream.tellg() < info.data_offset + info.row_stride * info.height)
+    {
+        info.valid = false;
+    }
+    stream.close();
+    return info;
+}
 
-    for (int row = 0; row < height_pixels; row++)
+/*
+    Function that reads only the headers of a BMP file.
+    No pixel data is read, so this is cheap enough to validate a filename
+    or to size a job before it runs. Raw images are reported with the
+    RAW_IMAGE compression.
+    * @param filename is the location where the file is stored
+    @return the image properties and whether they are valid
+*/
+BmpInfo probe_image(string filename)
+{
+    BmpInfo info = {false, 0, 0, 0, 0, 0, 0};
+    fstream stream;
+    stream.open(filename, ios::in | ios::binary);
+    if (!stream.is_open())
     {
-        for (int col = 0; col < width_pixels; col ++)
+        return info;
+    }
+    // room for the color masks of a BI_BITFIELDS image
+    unsigned char header[BMP_MASKS_END] = {0};
+    stream.read((char*)header, BMP_MASKS_END);
+    streamsize header_size = stream.gcount();
+    if (header_size < BMP_PROBE_SIZE)
+    {
+        return info;
+    }
+    stream.clear();
+    if (memcmp(header, "SRAW", 4) == 0)
+    {
+        // raw images are filtered like uncompressed BMPs
+        stream.close();
+        RawInfo raw = probe_raw(filename);
+        info = {raw.valid, raw.data_offset + raw.row_stride * raw.height, (int)raw.data_offset,
+                raw.width, raw.height, raw.channels * 8, RAW_IMAGE};
+        return info;
+    }
+    info = parse_header(header, header_size);
+
+    // a truncated file has a valid header but not all of its pixels
+    stream.seekg(0, ios::end);
+    if (info.valid && stream.tellg() < info.file_size)
+    {
+        info.valid = false;
+    }
+    stream.close();
+    return info;
+}
+
+/*
+    Function that splits a range of work items across worker threads.
+    Each thread gets one contiguous block of the range.
+    * @param count is the number of work items
+    @param body is called with the [begin, end) block of each thread
+    @param threads is the most threads to use, 0 for one per hardware thread
+*/
+void parallel_for(int count, const function<void(int, int)>& body, int threads = 0)
+{
+    if (threads <= 0)
+    {
+        threads = thread::hardware_concurrency();
+    }
+    threads = max(1, min(threads, count));
+    if (threads <= 1)
+    {
+        body(0, count);
+        return;
+    }
+    vector<thread> workers;
+    int chunk = (count + threads - 1) / threads;
+    for (int begin = 0; begin < count; begin += chunk)
+    {
+        int end = min(count, begin + chunk);
+        workers.push_back(thread(body, begin, end));
+    }
+    for (thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// Kernels with tunable settings
+const int KERNEL_PIXEL = 0;
+const int KERNEL_ROTATE = 1;
+const int KERNEL_CONVOLUTION = 2;
+const int KERNEL_RESAMPLE = 3;
+const int KERNEL_COUNT = 4;
+const char* const KERNEL_NAMES[KERNEL_COUNT] = {"pixel", "rotate", "convolution", "resample"};
+
+// Image size classes, each with its own settings
+const int SIZE_SMALL = 0;
+const int SIZE_MEDIUM = 1;
+const int SIZE_LARGE = 2;
+const int SIZE_CLASSES = 3;
+const char* const SIZE_NAMES[SIZE_CLASSES] = {"small", "medium", "large"};
+// Smallest image, in pixels, of the medium and large classes
+const long long MEDIUM_PIXELS = 1000000;
+const long long LARGE_PIXELS = 4000000;
+
+// Rotation kernels
+const int ROTATE_ROWS = 0;
+const int ROTATE_BLOCKED = 1;
+
+// How a kernel runs on one size class
+struct KernelConfig
+{
+    // most threads to use, 0 for one per hardware thread
+    int threads;
+    // which implementation to run, for kernels that have several
+    int variant;
+    // block size: rotation blocks, pixel filter bands
+    int block_width;
+    int block_height;
+};
+
+/*
+    Settings of each kernel and size class. The defaults are the settings
+    the kernels had before they were tunable; --tune replaces them with
+    the fastest settings measured on this machine.
+*/
+KernelConfig kernel_tuning[KERNEL_COUNT][SIZE_CLASSES] = {
+    {{1, 0, 0, 64}, {1, 0, 0, 64}, {1, 0, 0, 64}},
+    {{1, ROTATE_ROWS, 32, 32}, {1, ROTATE_ROWS, 32, 32}, {1, ROTATE_ROWS, 32, 32}},
+    {{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}},
+    {{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}},
+};
+
+/*
+    Function that gets the size class of an image.
+    * @param pixels is the number of pixels in the image
+    @return SIZE_SMALL, SIZE_MEDIUM or SIZE_LARGE
+*/
+int size_class(long long pixels)
+{
+    return pixels >= LARGE_PIXELS ? SIZE_LARGE : (pixels >= MEDIUM_PIXELS ? SIZE_MEDIUM : SIZE_SMALL);
+}
+
+/*
+    Function that gets the settings a kernel uses for an image.
+    * @param kernel is one of the KERNEL_ constants
+    @param pixels is the number of pixels in the image
+    @return the settings of the kernel for the size class of the image
+*/
+const KernelConfig& kernel_config(int kernel, long long pixels)
+{
+    return kernel_tuning[kernel][size_class(pixels)];
+}
+
+/*
+    Function that creates the BMP and DIB headers, the same fields
+    write_image() writes. The palette (if any) follows the headers.
+    * @param header is the BMP_PROBE_SIZE byte array to fill
+    @param width_pixels is the image width
+    @param height_pixels is the image height
+    @param bits_per_pixel is the bits per pixel
+    @param colors is the number of palette entries
+    @param compression is BI_RGB, BI_RLE8 or BI_RLE4
+    @param array_bytes is the size of the pixel array
+*/
+void make_header(unsigned char header[], int width_pixels, int height_pixels, int bits_per_pixel, int colors, int compression, int array_bytes)
+{
+    int start = BMP_PROBE_SIZE + colors * 4;
+    memset(header, 0, BMP_PROBE_SIZE);
+    set_bytes(header,  0, 1, 'B');                  // ID field
+    set_bytes(header,  1, 1, 'M');                  // ID field
+    set_bytes(header,  2, 4, start + array_bytes);  // Size of BMP file
+    set_bytes(header, 10, 4, start);                // Pixel array offset
+    set_bytes(header, 14, 4, 40);                   // DIB header size
+    set_bytes(header, 18, 4, width_pixels);         // Width of bitmap in pixels
+    set_bytes(header, 22, 4, height_pixels);        // Height of bitmap in pixels
+    set_bytes(header, 26, 2, 1);                    // Number of color planes
+    set_bytes(header, 28, 2, bits_per_pixel);       // Number of bits per pixel
+    set_bytes(header, 30, 4, compression);          // Compression method
+    set_bytes(header, 34, 4, array_bytes);          // Size of raw bitmap data
+    set_bytes(header, 38, 4, 2835);                 // Print resolution (pixels/meter)
+    set_bytes(header, 42, 4, 2835);                 // Print resolution (pixels/meter)
+    set_bytes(header, 46, 4, colors);               // Number of colors in palette
+}
+
+/*
+    Function that reads the palette of a 1, 4 or 8 bit BMP.
+    * @param data is the file, at least up to the pixel array
+    @param info is the parsed header
+    @param palette is filled with 2^bits colors, indices past the stored palette are black
+    @return false if the palette does not fit before the pixel array
+*/
+bool read_palette(const unsigned char* data, const BmpInfo& info, vector<Pixel>& palette)
+{
+    palette.clear();
+    int bits = info.bits_per_pixel;
+    if (bits > 8)
+    {
+        return true;
+    }
+    int colors = palette_colors(data, bits);
+    // palette entries are stored blue, green, red, reserved
+    long long palette_start = 14 + (long long)get_bytes(data, 14, 4);
+    if (palette_start + colors * 4 > info.start)
+    {
+        return false;
+    }
+    for (int i = 0; i < colors; i++)
+    {
+        const unsigned char* entry = data + palette_start + i * 4;
+        palette.push_back({entry[2], entry[1], entry[0]});
+    }
+    palette.resize(1 << bits, {0, 0, 0});
+    return true;
+}
+
+/*
+    Function that decodes a run of pixels from an uncompressed scan line.
+    * @param src is the scan line, or the part of it that holds the pixels
+    @param bits is the bits per pixel
+    @param palette is the palette of a 1, 4 or 8 bit image
+    @param first_bit is the bit offset of the first pixel in src
+    @param count is the number of pixels to decode
+    @param dst is where the pixels are stored
+*/
+void decode_pixels(const unsigned char* src, int bits, const vector<Pixel>& palette, int first_bit, int count, Pixel* dst)
+{
+    if (bits >= 24)
+    {
+        // Note: BMP files store pixels in blue, green, red order
+        int bytes_per_pixel = bits / 8;
+        src += first_bit / 8;
+        for (int col = 0; col < count; col++)
         {
-            Pixel p = image[row][col];
-            double distance = sqrt(pow(col - width_pixels / 2, 2) + pow(row - height_pixels / 2, 2));
-            double scaling_factor = (height_pixels - distance) / height_pixels;
-            int newred =  p.red * scaling_factor;
-            int newgreen = ( p.green * scaling_factor);
-            int newblue =  (p.blue * scaling_factor);
-            // set new pixel to new color values.
-            Pixel newpixel = {newred, newgreen, newblue};
-            newimg[row][col] = newpixel;
+            dst[col].blue = src[col * bytes_per_pixel];
+            dst[col].green = src[col * bytes_per_pixel + 1];
+            dst[col].red = src[col * bytes_per_pixel + 2];
+        }
+        return;
+    }
+    int mask = (1 << bits) - 1;
+    for (int col = 0; col < count; col++)
+    {
+        int bit = first_bit + col * bits;
+        // the leftmost pixel is in the high bits of each byte
+        dst[col] = palette[(src[bit / 8] >> (8 - bits - bit % 8)) & mask];
+    }
+}
+
+/*
+    Function that decodes the pixel array of a BMP file that is in memory.
+    Handles 24 and 32 bit images, 1, 4 and 8 bit palette images and
+    BI_RLE8 / BI_RLE4 compressed images.
+    * @param data is the whole file
+    @param size is the number of bytes in data
+    @return the image, or an empty vector if it is not a valid BMP
+*/
+vector<vector<Pixel>> decode_bmp(const unsigned char* data, size_t size)
+{
+    if (size < (size_t)BMP_PROBE_SIZE)
+    {
+        return {};
+    }
+    BmpInfo info = parse_header(data, size);
+    if (!info.valid || size < (size_t)info.file_size)
+    {
+        return {};
+    }
+    int width = info.width;
+    int height = info.height;
+    int bits = info.bits_per_pixel;
+    vector<vector<Pixel>> image(height, vector<Pixel>(width));
 
+    vector<Pixel> palette;
+    if (!read_palette(data, info, palette))
+    {
+        return {};
+    }
+    if (!palette.empty())
+    {
+        // pixels an RLE image skips keep the first color
+        for (vector<Pixel>& row : image)
+        {
+            fill(row.begin(), row.end(), palette[0]);
         }
     }
 
-    return newimg;
+    const unsigned char* pixels = data + info.start;
+    size_t pixel_bytes = info.file_size - info.start;
+    if (info.compression == BI_RGB)
+    {
+        long long row_bytes = scanline_bytes(width, bits);
+        parallel_for(height, [&](int begin, int end)
+        {
+            for (int row = begin; row < end; row++)
+            {
+                // Note: BMP files store pixels from bottom to top
+                const unsigned char* src = pixels + (height - 1 - row) * row_bytes;
+                decode_pixels(src, bits, palette, 0, width, image[row].data());
+            }
+        });
+        return image;
+    }
+
+    // run-length encoded, x and y count from the bottom left
+    int x = 0;
+    int y = 0;
+    size_t pos = 0;
+    while (pos + 1 < pixel_bytes && y < height)
+    {
+        int count = pixels[pos];
+        int value = pixels[pos + 1];
+        pos += 2;
+        if (count > 0)
+        {
+            // encoded mode: count pixels of one index (or two alternating nibbles)
+            for (int i = 0; i < count && x < width; i++, x++)
+            {
+                int index = bits == 8 ? value : (i % 2 == 0 ? value >> 4 : value & 15);
+                image[height - 1 - y][x] = palette[index];
+            }
+        }
+        else if (value == 0)
+        {
+            // end of line
+            x = 0;
+            y++;
+        }
+        else if (value == 1)
+        {
+            // end of bitmap
+            break;
+        }
+        else if (value == 2)
+        {
+            // delta to a later position
+            if (pos + 1 >= pixel_bytes)
+            {
+                break;
+            }
+            x += pixels[pos];
+            y += pixels[pos + 1];
+            pos += 2;
+        }
+        else
+        {
+            // absolute mode: value literal indices, padded to a 16 bit boundary
+            int literal_bytes = bits == 8 ? value : (value + 1) / 2;
+            if (pos + literal_bytes > pixel_bytes)
+            {
+                break;
+            }
+            for (int i = 0; i < value; i++)
+            {
+                int index = bits == 8 ? pixels[pos + i] : (i % 2 == 0 ? pixels[pos + i / 2] >> 4 : pixels[pos + i / 2] & 15);
+                if (x < width && y < height)
+                {
+                    image[height - 1 - y][x] = palette[index];
+                }
+                x++;
+            }
+            pos += literal_bytes + literal_bytes % 2;
+        }
+    }
+    return image;
 }
+
+// Largest block of scan lines a decode or encode thread reads or writes at once
+const long long IO_CHUNK_BYTES = 1 << 20;
+
 /*
-    Function that scales colors of pixels based on existing colors.
-    * @param filename is the location where the file is stored
-    @param scaling_factor is the scale at which the pixel colors are changed
-    @return a new image with a clarendon affect.
+    Function that reads from a file descriptor at an offset until all the
+    bytes are read. The file position is not used, so threads can share it.
+    * @param fd is the file descriptor
+    @param buffer is where the bytes are stored
+    @param bytes is the number of bytes to read
+    @param offset is the file offset to read from
+    @return true if all the bytes were read
 */
-vector<vector<Pixel>> proc2(string filename, double scaling_factor)
+bool pread_all(int fd, unsigned char* buffer, size_t bytes, off_t offset)
 {
-    // Call the read_image function and return its result
-    vector<vector<Pixel>> image = read_image(filename);
-    // Getting the size of the width and heigh pixels
-    int width_pixels = image[0].size();
-    int height_pixels = image.size();
-    // defines a new image withe strucutr pixels and the same size as the orginal image 
-    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
-    Pixel newpixel;
-    /*
-    Loop below adds a vintage effect to an image 
-    by scaling based on the average color of each pixel
-    */
-    for (int row = 0; row < height_pixels; row++)
+    while (bytes > 0)
+    {
+        ssize_t done = pread(fd, buffer, bytes, offset);
+        if (done <= 0)
+        {
+            return false;
+        }
+        buffer += done;
+        bytes -= done;
+        offset += done;
+    }
+    return true;
+}
+
+/*
+    Function that writes to a file descriptor at an offset until all the
+    bytes are written.
+    * @param fd is the file descriptor
+    @param buffer is the bytes to write
+    @param bytes is the number of bytes to write
+    @param offset is the file offset to write to
+    @return true if all the bytes were written
+*/
+bool pwrite_all(int fd, const unsigned char* buffer, size_t bytes, off_t offset)
+{
+    while (bytes > 0)
+    {
+        ssize_t done = pwrite(fd, buffer, bytes, offset);
+        if (done <= 0)
+        {
+            return false;
+        }
+        buffer += done;
+        bytes -= done;
+        offset += done;
+    }
+    return true;
+}
+
+/*
+    Function that decodes an uncompressed BMP with one thread per block of rows.
+    Rows sit at fixed offsets, so each thread reads its own scan lines
+    with pread and there is no shared stream position.
+    * @param filename is the location where the file is stored
+    @param info is the probed image, which must be uncompressed
+    @return the image, or an empty vector if it could not be read
+*/
+vector<vector<Pixel>> load_image_parallel(string filename, const BmpInfo& info)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return {};
+    }
+    // the headers and palette come before the pixel array
+    vector<unsigned char> header(info.start);
+    vector<Pixel> palette;
+    if (!pread_all(fd, header.data(), header.size(), 0) || !read_palette(header.data(), info, palette))
+    {
+        close(fd);
+        return {};
+    }
+
+    int width = info.width;
+    int height = info.height;
+    int bits = info.bits_per_pixel;
+    long long row_bytes = scanline_bytes(width, bits);
+    int chunk_rows = max(1LL, IO_CHUNK_BYTES / row_bytes);
+    vector<vector<Pixel>> image(height, vector<Pixel>(width));
+    atomic<bool> ok(true);
+    parallel_for(height, [&](int begin, int end)
+    {
+        vector<unsigned char> buffer;
+        for (int first = begin; first < end && ok; first += chunk_rows)
+        {
+            int rows = min(chunk_rows, end - first);
+            // image rows first..first+rows-1 are one block of the file, last row first
+            off_t offset = info.start + (height - first - rows) * row_bytes;
+            buffer.resize(rows * row_bytes);
+            if (!pread_all(fd, buffer.data(), buffer.size(), offset))
+            {
+                ok = false;
+                return;
+            }
+            for (int row = 0; row < rows; row++)
+            {
+                const unsigned char* src = &buffer[(rows - 1 - row) * row_bytes];
+                decode_pixels(src, bits, palette, 0, width, image[first + row].data());
+            }
+        }
+    });
+    close(fd);
+    if (!ok)
+    {
+        return {};
+    }
+    return image;
+}
+
+/*
+    Function that maps a whole file into memory for reading.
+    * @param filename is the location where the file is stored
+    @param size is the number of bytes to map
+    @return the mapped bytes, or nullptr if the file could not be mapped
+*/
+const unsigned char* map_file(const string& filename, size_t size)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file open
+    close(fd);
+    return map == MAP_FAILED ? nullptr : (const unsigned char*)map;
+}
+
+/*
+    Function that creates a file of a fixed size and maps it for writing.
+    The space is allocated up front, so a full disk is an error here and
+    not a crash while the mapped pages are written.
+    * @param filename is the file to create
+    @param size is the size of the file
+    @return the mapped bytes, all zero, or nullptr if the file could not be created
+*/
+unsigned char* map_new_file(const string& filename, size_t size)
+{
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    void* map = MAP_FAILED;
+    if (posix_fallocate(fd, 0, size) == 0)
+    {
+        map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return map == MAP_FAILED ? nullptr : (unsigned char*)map;
+}
+
+/*
+    Function that reads a raw image with one thread per block of rows.
+    The file is mapped, so rows are read straight from the page cache.
+    * @param filename is the location where the file is stored
+    @return the image, or an empty vector if it is not a valid raw image
+*/
+vector<vector<Pixel>> load_raw_image(string filename)
+{
+    RawInfo info = probe_raw(filename);
+    if (!info.valid)
+    {
+        return {};
+    }
+    size_t size = info.data_offset + info.row_stride * info.height;
+    const unsigned char* data = map_file(filename, size);
+    if (data == nullptr)
+    {
+        return {};
+    }
+    int width = info.width;
+    int channels = info.channels;
+    // byte of the red and blue channels within a pixel
+    int red = (info.layout == RAW_RGB || info.layout == RAW_RGBA) ? 0 : 2;
+    int blue = 2 - red;
+    vector<vector<Pixel>> image(info.height, vector<Pixel>(width));
+    parallel_for(info.height, [&](int begin, int end)
+    {
+        for (int row = begin; row < end; row++)
+        {
+            const unsigned char* src = data + info.data_offset + row * info.row_stride;
+            Pixel* dst = image[row].data();
+            for (int col = 0; col < width; col++)
+            {
+                const unsigned char* p = src + col * channels;
+                dst[col] = {p[red], p[1], p[blue]};
+            }
+        }
+    });
+    munmap((void*)data, size);
+    return image;
+}
+
+/*
+    Function that reads a BMP image and decodes it.
+    Uncompressed images are decoded in parallel, compressed ones are read
+    with one bulk read. Unlike read_image() this also reads palette and
+    RLE images, and raw images.
+    * @param filename is the location where the file is stored
+    @return the image, or an empty vector if it is not a valid BMP
+*/
+vector<vector<Pixel>> load_image(string filename)
+{
+    BmpInfo info = probe_image(filename);
+    if (info.valid && info.compression == BI_RGB)
+    {
+        return load_image_parallel(filename, info);
+    }
+    if (info.compression == RAW_IMAGE)
+    {
+        return load_raw_image(filename);
+    }
+    fstream stream;
+    stream.open(filename, ios::in | ios::binary);
+    if (!stream.is_open())
+    {
+        return {};
+    }
+    stream.seekg(0, ios::end);
+    streamoff size = stream.tellg();
+    if (size < BMP_PROBE_SIZE)
+    {
+        return {};
+    }
+    vector<unsigned char> data(size);
+    stream.seekg(0);
+    stream.read((char*)data.data(), size);
+    stream.close();
+    return decode_bmp(data.data(), data.size());
+}
+
+// A rectangle of an image, in pixels from the top left corner
+struct Region
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+/*
+    Function that clips a region to the bounds of an image.
+    * @param region is the requested region
+    @param info is the probed image
+    @return the part of the region inside the image, with zero width or height if none of it is
+*/
+Region clip_region(Region region, const BmpInfo& info)
+{
+    // a region near the int limits must not overflow
+    long long right = min((long long)info.width, (long long)region.x + region.width);
+    long long bottom = min((long long)info.height, (long long)region.y + region.height);
+    region.x = max(0, region.x);
+    region.y = max(0, region.y);
+    region.width = max(0LL, right - region.x);
+    region.height = max(0LL, bottom - region.y);
+    return region;
+}
+
+/*
+    Function that reads only a rectangle of a BMP image.
+    For uncompressed images only the scan lines of the region are read,
+    and only the bytes of each line that hold its columns. Run-length
+    encoded images cannot be seeked into, so they are decoded whole and
+    cropped.
+    * @param filename is the location where the file is stored
+    @param region is the rectangle to read, already clipped to the image
+    @return the pixels of the region, or an empty vector if the image is not valid
+*/
+vector<vector<Pixel>> load_image_roi(string filename, const Region& region)
+{
+    BmpInfo info = probe_image(filename);
+    if (!info.valid || region.width <= 0 || region.height <= 0)
+    {
+        return {};
+    }
+    if (info.compression != BI_RGB)
+    {
+        vector<vector<Pixel>> image = load_image(filename);
+        if (image.empty())
+        {
+            return {};
+        }
+        vector<vector<Pixel>> crop(region.height);
+        for (int row = 0; row < region.height; row++)
+        {
+            crop[row].assign(image[region.y + row].begin() + region.x, image[region.y + row].begin() + region.x + region.width);
+        }
+        return crop;
+    }
+
+    fstream stream;
+    stream.open(filename, ios::in | ios::binary);
+    // the headers and palette come before the pixel array
+    vector<unsigned char> header(info.start);
+    stream.read((char*)header.data(), header.size());
+    vector<Pixel> palette;
+    if (!stream || !read_palette(header.data(), info, palette))
+    {
+        return {};
+    }
+
+    int bits = info.bits_per_pixel;
+    long long row_bytes = scanline_bytes(info.width, bits);
+    long long first_byte = (long long)region.x * bits / 8;
+    long long last_byte = ((long long)(region.x + region.width) * bits + 7) / 8;
+    vector<unsigned char> line(last_byte - first_byte);
+    vector<vector<Pixel>> image(region.height, vector<Pixel>(region.width));
+    // rows are read bottom to top so the file is read in order
+    for (int row = region.height - 1; row >= 0; row--)
+    {
+        long long file_row = info.height - 1 - (region.y + row);
+        stream.seekg(info.start + file_row * row_bytes + first_byte);
+        stream.read((char*)line.data(), line.size());
+        if (!stream)
+        {
+            return {};
+        }
+        int first_bit = (long long)region.x * bits - first_byte * 8;
+        decode_pixels(line.data(), bits, palette, first_bit, region.width, image[row].data());
+    }
+    return image;
+}
+
+/*
+    Function that run-length encodes one row of palette indices.
+    Runs of two or more equal indices use encoded mode, anything else
+    uses absolute mode (or single pixel runs when it is too short).
+    * @param indices is the row of palette indices
+    @param bits is 8 for BI_RLE8 or 4 for BI_RLE4
+    @param out is the pixel array to append to
+*/
+void encode_rle_row(const vector<unsigned char>& indices, int bits, vector<unsigned char>& out)
+{
+    int width = indices.size();
+    int i = 0;
+    while (i < width)
+    {
+        int run = 1;
+        while (i + run < width && run < 255 && indices[i + run] == indices[i])
+        {
+            run++;
+        }
+        if (run >= 2)
+        {
+            out.push_back(run);
+            out.push_back(bits == 8 ? indices[i] : indices[i] << 4 | indices[i]);
+            i += run;
+            continue;
+        }
+
+        // literal pixels up to the start of the next run
+        int end = i + 1;
+        while (end < width && end - i < 255 && (end + 1 >= width || indices[end] != indices[end + 1]))
+        {
+            end++;
+        }
+        int count = end - i;
+        if (count < 3)
+        {
+            // absolute mode needs at least three pixels
+            for (; i < end; i++)
+            {
+                out.push_back(1);
+                out.push_back(bits == 8 ? indices[i] : indices[i] << 4);
+            }
+            continue;
+        }
+        out.push_back(0);
+        out.push_back(count);
+        int literal_bytes = 0;
+        for (int k = 0; k < count; k += bits == 8 ? 1 : 2, literal_bytes++)
+        {
+            if (bits == 8)
+            {
+                out.push_back(indices[i + k]);
+            }
+            else
+            {
+                int low = k + 1 < count ? indices[i + k + 1] : 0;
+                out.push_back(indices[i + k] << 4 | low);
+            }
+        }
+        if (literal_bytes % 2 != 0)
+        {
+            out.push_back(0);
+        }
+        i = end;
+    }
+}
+
+/*
+    Function that gets the fewest bits per pixel that fit a palette.
+    * @param colors is the number of colors in the palette, at most 256
+    @return 1, 4 or 8
+*/
+int palette_bits(int colors)
+{
+    return colors <= 2 ? 1 : (colors <= 16 ? 4 : 8);
+}
+
+/*
+    Function that builds the lookup from a color to its palette index.
+    * @param palette is the palette
+    @return the index of each red << 16 | green << 8 | blue key
+*/
+unordered_map<int, int> palette_lookup(const vector<Pixel>& palette)
+{
+    unordered_map<int, int> lookup;
+    for (size_t i = 0; i < palette.size(); i++)
+    {
+        lookup[palette[i].red << 16 | palette[i].green << 8 | palette[i].blue] = i;
+    }
+    return lookup;
+}
+
+/*
+    Function that converts a row of pixels to palette indices.
+    * @param row is the row of pixels
+    @param width is the number of pixels in the row
+    @param lookup is the palette index of each color, from palette_lookup()
+    @param indices receives one index per pixel
+    @return false if a pixel is not in the palette
+*/
+bool palette_indices(const Pixel* row, int width, const unordered_map<int, int>& lookup, unsigned char* indices)
+{
+    int last_key = -1;
+    int last_index = 0;
+    for (int w = 0; w < width; w++)
+    {
+        int key = row[w].red << 16 | row[w].green << 8 | row[w].blue;
+        if (key != last_key)
+        {
+            auto found = lookup.find(key);
+            if (found == lookup.end())
+            {
+                return false;
+            }
+            last_key = key;
+            last_index = found->second;
+        }
+        indices[w] = last_index;
+    }
+    return true;
+}
+
+/*
+    Function that packs palette indices into an uncompressed 1, 4 or 8
+    bit scan line, first pixel in the high bits.
+    * @param indices is one index per pixel
+    @param width is the number of pixels
+    @param bits is the bits per pixel
+    @param dst receives the packed pixels, the padding is left as it is
+*/
+void pack_indices(const unsigned char* indices, int width, int bits, unsigned char* dst)
+{
+    fill(dst, dst + ((long long)width * bits + 7) / 8, 0);
+    for (int w = 0; w < width; w++)
+    {
+        int bit = w * bits;
+        dst[bit / 8] |= indices[w] << (8 - bits - bit % 8);
+    }
+}
+
+/*
+    Function that encodes a palette the way a BMP stores it.
+    * @param palette is the palette
+    @return blue, green, red and a zero byte for every color
+*/
+vector<unsigned char> encode_palette(const vector<Pixel>& palette)
+{
+    vector<unsigned char> palette_bytes(palette.size() * 4, 0);
+    for (size_t i = 0; i < palette.size(); i++)
+    {
+        palette_bytes[i * 4] = palette[i].blue;
+        palette_bytes[i * 4 + 1] = palette[i].green;
+        palette_bytes[i * 4 + 2] = palette[i].red;
+    }
+    return palette_bytes;
+}
+
+/*
+    Function that writes an image as a palette BMP.
+    The bits per pixel are the fewest that fit the palette (1, 4 or 8),
+    and 4 and 8 bit images can be run-length encoded.
+    * @param filename is the BMP file name to save the image to
+    @param image is the image to save
+    @param palette is every color the image uses, at most 256
+    @param rle is true to use BI_RLE4 / BI_RLE8 compression
+    @return true if successful and false if a pixel is not in the palette or the file could not be written
+*/
+bool write_indexed_image(string filename, const vector<vector<Pixel>>& image, const vector<Pixel>& palette, bool rle)
+{
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    int colors = palette.size();
+    int bits = palette_bits(colors);
+    int compression = BI_RGB;
+    if (rle && bits > 1)
+    {
+        compression = bits == 8 ? BI_RLE8 : BI_RLE4;
+    }
+
+    // palette index of every color
+    unordered_map<int, int> lookup = palette_lookup(palette);
+
+    long long row_bytes = scanline_bytes(width_pixels, bits);
+    vector<unsigned char> pixels;
+    if (compression == BI_RGB)
+    {
+        pixels.reserve(row_bytes * height_pixels);
+    }
+    vector<unsigned char> indices(width_pixels);
+    // Pixel Array (Left to right, bottom to top)
+    for (int h = height_pixels - 1; h >= 0; h--)
+    {
+        if (!palette_indices(image[h].data(), width_pixels, lookup, indices.data()))
+        {
+            return false;
+        }
+        if (compression != BI_RGB)
+        {
+            encode_rle_row(indices, bits, pixels);
+            // end of line, or end of bitmap after the last line
+            pixels.push_back(0);
+            pixels.push_back(h == 0 ? 1 : 0);
+            continue;
+        }
+        size_t row_start = pixels.size();
+        pixels.resize(row_start + row_bytes, 0);
+        pack_indices(indices.data(), width_pixels, bits, &pixels[row_start]);
+    }
+
+    // noisy images can come out larger run-length encoded
+    if (compression != BI_RGB && (long long)pixels.size() > row_bytes * height_pixels)
+    {
+        return write_indexed_image(filename, image, palette, false);
+    }
+
+    unsigned char header[BMP_PROBE_SIZE];
+    make_header(header, width_pixels, height_pixels, bits, colors, compression, pixels.size());
+    vector<unsigned char> palette_bytes = encode_palette(palette);
+
+    fstream stream;
+    stream.open(filename, ios::out | ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+    stream.write((char*)header, BMP_PROBE_SIZE);
+    stream.write((char*)palette_bytes.data(), palette_bytes.size());
+    stream.write((char*)pixels.data(), pixels.size());
+    stream.close();
+    return !stream.fail();
+}
+
+/*
+    Function that encodes rows of an image as 24 bit BMP scan lines.
+    * @param image is the image
+    @param first is the first row to encode
+    @param rows is the number of rows to encode
+    @param dst receives the scan lines bottom to top, with zero padding
+*/
+void encode_rows(const vector<vector<Pixel>>& image, int first, int rows, unsigned char* dst)
+{
+    int width_pixels = image[0].size();
+    long long row_bytes = scanline_bytes(width_pixels, 24);
+    for (int row = 0; row < rows; row++)
+    {
+        unsigned char* line = dst + (rows - 1 - row) * row_bytes;
+        const vector<Pixel>& src = image[first + row];
+        for (int col = 0; col < width_pixels; col++)
+        {
+            line[col * 3] = src[col].blue;
+            line[col * 3 + 1] = src[col].green;
+            line[col * 3 + 2] = src[col].red;
+        }
+        fill(line + width_pixels * 3, line + row_bytes, 0);
+    }
+}
+
+/*
+    Function that encodes an image as a 24 bit BMP file in memory, the
+    same bytes write_image() writes.
+    * @param image is the image to encode
+    @return the whole file
+*/
+vector<unsigned char> encode_bmp(const vector<vector<Pixel>>& image)
+{
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    long long row_bytes = scanline_bytes(width_pixels, 24);
+    vector<unsigned char> data(BMP_PROBE_SIZE + row_bytes * height_pixels);
+    make_header(data.data(), width_pixels, height_pixels, 24, 0, BI_RGB, row_bytes * height_pixels);
+    parallel_for(height_pixels, [&](int begin, int end)
+    {
+        // rows begin..end-1 end at the bottom-up file row height - end
+        encode_rows(image, begin, end - begin, &data[BMP_PROBE_SIZE + (height_pixels - end) * row_bytes]);
+    });
+    return data;
+}
+
+/*
+    Function that writes a 24 bit BMP with one thread per block of rows,
+    byte for byte the same file as write_image().
+    Each thread encodes its own rows and writes them with pwrite.
+    * @param filename is the BMP file name to save the image to
+    @param image is the image to save
+    @return true if successful and false otherwise
+*/
+bool write_image_parallel(string filename, const vector<vector<Pixel>>& image)
+{
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    long long row_bytes = scanline_bytes(width_pixels, 24);
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    unsigned char header[BMP_PROBE_SIZE];
+    make_header(header, width_pixels, height_pixels, 24, 0, BI_RGB, row_bytes * height_pixels);
+    // size the file first so every thread writes inside it
+    bool ok = pwrite_all(fd, header, BMP_PROBE_SIZE, 0)
+        && ftruncate(fd, BMP_PROBE_SIZE + row_bytes * height_pixels) == 0;
+
+    int chunk_rows = max(1LL, IO_CHUNK_BYTES / row_bytes);
+    atomic<bool> written(ok);
+    parallel_for(ok ? height_pixels : 0, [&](int begin, int end)
+    {
+        vector<unsigned char> buffer;
+        for (int first = begin; first < end && written; first += chunk_rows)
+        {
+            int rows = min(chunk_rows, end - first);
+            buffer.resize(rows * row_bytes);
+            encode_rows(image, first, rows, buffer.data());
+            off_t offset = BMP_PROBE_SIZE + (height_pixels - first - rows) * row_bytes;
+            if (!pwrite_all(fd, buffer.data(), buffer.size(), offset))
+            {
+                written = false;
+            }
+        }
+    });
+    return close(fd) == 0 && written;
+}
+
+/*
+    Function that fills in a raw image header.
+    * @param header is the RAW_HEADER_SIZE byte array to fill
+    @param width_pixels is the image width
+    @param height_pixels is the image height
+    @param layout is the channel layout of the rows
+*/
+void make_raw_header(unsigned char header[], int width_pixels, int height_pixels, int layout)
+{
+    int channels = (layout == RAW_RGBA || layout == RAW_BGRA) ? 4 : 3;
+    long long stride = raw_stride(width_pixels, channels);
+    long long data_bytes = stride * height_pixels;
+    memset(header, 0, RAW_HEADER_SIZE);
+    memcpy(header, "SRAW", 4);                           // ID field
+    set_bytes(header,  4, 4, RAW_VERSION);               // Format version
+    set_bytes(header,  8, 4, RAW_HEADER_SIZE);           // Offset of the first row
+    set_bytes(header, 12, 4, width_pixels);              // Width in pixels
+    set_bytes(header, 16, 4, height_pixels);             // Height in pixels
+    set_bytes(header, 20, 4, channels);                  // Bytes per pixel
+    set_bytes(header, 24, 4, layout);                    // Channel layout
+    set_bytes(header, 28, 4, 8);                         // Bits per channel
+    for (int i = 0; i < 8; i++)
+    {
+        header[32 + i] = stride >> (i * 8);              // Row stride
+        header[40 + i] = data_bytes >> (i * 8);          // Size of all rows
+    }
+}
+
+/*
+    Function that writes an image as a raw image with one thread per block
+    of rows, straight into the mapped output file.
+    * @param filename is the raw file name to save the image to
+    @param image is the image to save
+    @param layout is the channel layout to store, alpha is saved opaque
+    @return true if successful and false otherwise
+*/
+bool write_raw_image(string filename, const vector<vector<Pixel>>& image, int layout = RAW_RGB)
+{
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    int channels = (layout == RAW_RGBA || layout == RAW_BGRA) ? 4 : 3;
+    long long stride = raw_stride(width_pixels, channels);
+    size_t size = RAW_HEADER_SIZE + stride * height_pixels;
+    unsigned char* data = map_new_file(filename, size);
+    if (data == nullptr)
+    {
+        return false;
+    }
+    make_raw_header(data, width_pixels, height_pixels, layout);
+    int red = (layout == RAW_RGB || layout == RAW_RGBA) ? 0 : 2;
+    int blue = 2 - red;
+    parallel_for(height_pixels, [&](int begin, int end)
+    {
+        for (int row = begin; row < end; row++)
+        {
+            unsigned char* dst = data + RAW_HEADER_SIZE + row * stride;
+            const Pixel* src = image[row].data();
+            for (int col = 0; col < width_pixels; col++)
+            {
+                unsigned char* p = dst + col * channels;
+                p[red] = src[col].red;
+                p[1] = src[col].green;
+                p[blue] = src[col].blue;
+                if (channels == 4)
+                {
+                    p[3] = 255;
+                }
+            }
+        }
+    });
+    return munmap(data, size) == 0;
+}
+
+/*
+    Function that converts a BMP image to a raw image.
+    Uncompressed 24 and 32 bit images keep their byte order (BGR or
+    BGRA), so each row is one copy from the mapped BMP to the mapped raw
+    file; 32 bit rows then get an opaque alpha. Palette and RLE images
+    are decoded first.
+    * @param filename is the BMP image
+    @param output_filename is the raw file to write
+    @return true if the raw image was written
+*/
+bool bmp_to_raw(const string& filename, const string& output_filename)
+{
+    BmpInfo info = probe_image(filename);
+    if (!info.valid || info.compression == RAW_IMAGE)
+    {
+        return false;
+    }
+    if (info.compression != BI_RGB || info.bits_per_pixel < 24)
+    {
+        vector<vector<Pixel>> image = load_image(filename);
+        return !image.empty() && write_raw_image(output_filename, image, RAW_BGR);
+    }
+    int width = info.width;
+    int height = info.height;
+    int channels = info.bits_per_pixel / 8;
+    long long row_bytes = scanline_bytes(width, info.bits_per_pixel);
+    long long stride = raw_stride(width, channels);
+    size_t size = RAW_HEADER_SIZE + stride * height;
+    const unsigned char* src = map_file(filename, info.file_size);
+    unsigned char* dst = src == nullptr ? nullptr : map_new_file(output_filename, size);
+    if (dst == nullptr)
+    {
+        if (src != nullptr)
+        {
+            munmap((void*)src, info.file_size);
+        }
+        return false;
+    }
+    make_raw_header(dst, width, height, channels == 3 ? RAW_BGR : RAW_BGRA);
+    parallel_for(height, [&](int begin, int end)
+    {
+        for (int row = begin; row < end; row++)
+        {
+            // the BMP stores the last row first
+            unsigned char* out = dst + RAW_HEADER_SIZE + row * stride;
+            memcpy(out, src + info.start + (height - 1 - row) * row_bytes, width * channels);
+            // the fourth byte of a BI_RGB pixel is unused and usually 0,
+            // so make every pixel opaque rather than transparent
+            for (int col = channels == 4 ? 0 : width; col < width; col++)
+            {
+                out[col * 4 + 3] = 255;
+            }
+        }
+    });
+    munmap((void*)src, info.file_size);
+    return munmap(dst, size) == 0;
+}
+
+/*
+    Function that converts a raw image to a BMP image.
+    BGR and BGRA rows are already in BMP byte order and become a 24 or
+    32 bit BMP with one copy per row. RGB and RGBA rows are decoded and
+    saved as a 24 bit BMP.
+    * @param filename is the raw image
+    @param output_filename is the BMP file to write
+    @return true if the BMP was written
+*/
+bool raw_to_bmp(const string& filename, const string& output_filename)
+{
+    RawInfo info = probe_raw(filename);
+    if (!info.valid)
+    {
+        return false;
+    }
+    if (info.layout == RAW_RGB || info.layout == RAW_RGBA)
+    {
+        vector<vector<Pixel>> image = load_raw_image(filename);
+        return !image.empty() && write_image_parallel(output_filename, image);
+    }
+    int width = info.width;
+    int height = info.height;
+    int bits = info.channels * 8;
+    long long row_bytes = scanline_bytes(width, bits);
+    size_t src_size = info.data_offset + info.row_stride * height;
+    size_t size = BMP_PROBE_SIZE + row_bytes * height;
+    const unsigned char* src = map_file(filename, src_size);
+    unsigned char* dst = src == nullptr ? nullptr : map_new_file(output_filename, size);
+    if (dst == nullptr)
+    {
+        if (src != nullptr)
+        {
+            munmap((void*)src, src_size);
+        }
+        return false;
+    }
+    make_header(dst, width, height, bits, 0, BI_RGB, row_bytes * height);
+    parallel_for(height, [&](int begin, int end)
+    {
+        for (int row = begin; row < end; row++)
+        {
+            // the padding of each scan line is already zero
+            memcpy(dst + BMP_PROBE_SIZE + (height - 1 - row) * row_bytes, src + info.data_offset + row * info.row_stride, width * info.channels);
+        }
+    });
+    munmap((void*)src, src_size);
+    return munmap(dst, size) == 0;
+}
+
+/*
+    Function that writes an image over a rectangle of an existing 24 or
+    32 bit BMP, leaving the rest of the file untouched.
+    * @param filename is the BMP file to patch
+    @param image is the pixels to write
+    @param x is the column of the top left corner of the patch
+    @param y is the row of the top left corner of the patch
+    @return true if successful and false if the patch does not fit or the file could not be written
+*/
+bool patch_image(string filename, const vector<vector<Pixel>>& image, int x, int y)
+{
+    BmpInfo info = probe_image(filename);
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    if (!info.valid || info.bits_per_pixel < 24 || info.compression != BI_RGB
+        || x < 0 || y < 0 || x + width_pixels > info.width || y + height_pixels > info.height)
+    {
+        return false;
+    }
+    fstream stream;
+    stream.open(filename, ios::in | ios::out | ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+    int bytes_per_pixel = info.bits_per_pixel / 8;
+    long long row_bytes = scanline_bytes(info.width, info.bits_per_pixel);
+    vector<unsigned char> line((size_t)width_pixels * bytes_per_pixel);
+    for (int row = height_pixels - 1; row >= 0; row--)
+    {
+        long long pos = info.start + (info.height - 1 - (long long)(y + row)) * row_bytes + (long long)x * bytes_per_pixel;
+        // read the line first so an alpha channel is kept
+        stream.seekg(pos);
+        stream.read((char*)line.data(), line.size());
+        for (int col = 0; col < width_pixels; col++)
+        {
+            line[col * bytes_per_pixel] = image[row][col].blue;
+            line[col * bytes_per_pixel + 1] = image[row][col].green;
+            line[col * bytes_per_pixel + 2] = image[row][col].red;
+        }
+        stream.seekp(pos);
+        stream.write((char*)line.data(), line.size());
+    }
+    stream.close();
+    return !stream.fail();
+}
+
+/*
+    Function that darkens the edges of an image.
+    * @param image is the image to filter
+    @param first_row is the row of the full image that image starts at
+    @param full_height is the height of the full image when image is only a band of it
+    @param first_col is the column of the full image that image starts at
+    @param full_width is the width of the full image when image is only a region of it
+    @return a new image with darker edges.
+*/
+vector<vector<Pixel>> proc1(const vector<vector<Pixel>>& image, int first_row = 0, int full_height = 0, int first_col = 0, int full_width = 0)
+{
+    // Getting the size of the width and heigh pixels
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    // a band or region is darkened relative to the center of the full image
+    int band_pixels = height_pixels;
+    int band_width = width_pixels;
+    if (full_height > 0)
+    {
+        height_pixels = full_height;
+    }
+    if (full_width > 0)
+    {
+        width_pixels = full_width;
+    }
+    // defines a new image withe strucutr pixels and the same size as the orginal image 
+    vector<vector<Pixel>> newimg(band_pixels, vector<Pixel>(band_width));
+    /*
+    The nested for loop below 
+    Adds vignette effect to image (dark corners)
+    and scales the colors based on the distance of the pixels from the 
+    center.
+    */
+
+    for (int row = 0; row < band_pixels; row++)
+    {
+        for (int col = 0; col < band_width; col ++)
+        {
+            Pixel p = image[row][col];
+            double distance = sqrt(pow(col + first_col - width_pixels / 2, 2) + pow(row + first_row - height_pixels / 2, 2));
+            double scaling_factor = (height_pixels - distance) / height_pixels;
+            int newred =  p.red * scaling_factor;
+            int newgreen = ( p.green * scaling_factor);
+            int newblue =  (p.blue * scaling_factor);
+            // set new pixel to new color values.
+            Pixel newpixel = {newred, newgreen, newblue};
+            newimg[row][col] = newpixel;
+
+        }
+    }
+
+    return newimg;
+}
+/*
+    Function that scales colors of pixels based on existing colors.
+    * @param image is the image to filter
+    @param scaling_factor is the scale at which the pixel colors are changed
+    @return a new image with a clarendon affect.
+*/
+vector<vector<Pixel>> proc2(const vector<vector<Pixel>>& image, double scaling_factor)
+{
+    // Getting the size of the width and heigh pixels
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    // defines a new image withe strucutr pixels and the same size as the orginal image 
+    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
+    Pixel newpixel;
+    /*
+    Loop below adds a vintage effect to an image 
+    by scaling based on the average color of each pixel
+    */
+    for (int row = 0; row < height_pixels; row++)
+    {
+        for (int col = 0; col < width_pixels; col ++)
+        {
+            Pixel p = image[row][col];
+            int red = p.red;
+            int blue =p.blue;
+            int green = p.green;
+            int average = (red+green+blue)/3;
+            int newred;
+            int newblue;
+            int newgreen;
+            // if the cell is light, make it lighter.
+            if (average >= 170)
+            {
+                newred = (255 - (255-red)*scaling_factor);
+                newblue = (255 - (255-blue)*scaling_factor);
+                newgreen = (255 - (255-green)*scaling_factor);
+                newpixel = {newred,newgreen,newblue};
+                newimg[row][col] = newpixel;
+
+            }
+            // if pixel is dark, scale to make darker
+            else if (average < 90)
+            {
+                newred= red*scaling_factor;
+                newblue= blue*scaling_factor;
+                newgreen= green*scaling_factor;
+                newpixel = {newred,newgreen,newblue};
+                newimg[row][col] = newpixel;
+            }
+            // if cell isnt light or dark, keep.
+            else 
+            {
+                int newred= red;
+                int newblue= blue;
+                int newgreen= green;
+                newpixel = {newred,newgreen,newblue};
+                newimg[row][col] = newpixel;
+
+            }
+            
+
+
+        }
+    }
+    return newimg;
+
+}
+/*
+    Function that changes the image to a grayscaled image
+    * @param image is the image to filter
+    @return a new grayscalled image.
+*/
+vector<vector<Pixel>> proc3(const vector<vector<Pixel>>& image)
+{
+    // Getting the size of the width and heigh pixels
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    // defines a new image withe strucutre pixels and the same size as the orginal image 
+    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
+
+    Pixel newpixel;
+    for (int row = 0; row < height_pixels; row++)
+    {
+        for (int col = 0; col < width_pixels; col ++)
+        {
+            //getting a pixel at row and col
+            Pixel p =image[row][col];
+            // getting red blue and green
+            int red = p.red;
+            int blue = p.blue;
+            int green =  p.green;
+            // getting the gray shade for the pixel
+            int gray_pixel = (red+blue+green)/3;
+            // setting each color for the gray value
+            int newred = gray_pixel;
+            int newblue =gray_pixel;
+            int newgreen = gray_pixel;
+            //setting color for new pixel
+            newpixel = {newred,newblue,newgreen};
+            //setting new pixel into the new image
+            newimg[row][col] = newpixel;
+
+        }
+    }
+    return newimg;
+
+
+}
+/*
+    Function that rotates an image 90 degrees one square block at a time,
+    so the rows being read and the rows being written both stay in cache.
+    Blocks of output rows are split across threads.
+    * @param image is the image to filter
+    @param config is the block size and thread count to use
+    @return a new rotated image.
+*/
+vector<vector<Pixel>> rotate_blocked(const vector<vector<Pixel>>& image, const KernelConfig& config)
+{
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    int block = max(1, config.block_width);
+    vector<vector<Pixel>> newimg(width_pixels, vector<Pixel>(height_pixels));
+    int blocks_across = (width_pixels + block - 1) / block;
+    parallel_for(blocks_across, [&](int begin, int end)
+    {
+        for (int col0 = begin * block; col0 < min(width_pixels, end * block); col0 += block)
+        {
+            int col1 = min(width_pixels, col0 + block);
+            for (int row0 = 0; row0 < height_pixels; row0 += block)
+            {
+                int row1 = min(height_pixels, row0 + block);
+                for (int row = row0; row < row1; row++)
+                {
+                    const Pixel* src = image[row].data();
+                    int dst_col = height_pixels - 1 - row;
+                    for (int col = col0; col < col1; col++)
+                    {
+                        newimg[col][dst_col] = src[col];
+                    }
+                }
+            }
+        }
+    }, config.threads);
+    return newimg;
+}
+
+/*
+    Function that rotates an image 90 degrees.
+    * @param image is the image to filter
+    @return a new rotated image.
+*/
+vector<vector<Pixel>> proc4(const vector<vector<Pixel>>& image)
+{
+    // Getting the size of the width and heigh pixels
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    const KernelConfig& config = kernel_config(KERNEL_ROTATE, (long long)width_pixels * height_pixels);
+    if (config.variant == ROTATE_BLOCKED)
+    {
+        return rotate_blocked(image, config);
+    }
+    // defines a new image withe strucutre pixels and rotated.
+    vector<vector<Pixel>> newimg(width_pixels, vector<Pixel>(height_pixels));
+    // loop thqt switches the row and col pixels of the new image so that it rotates.
+    for (int row = 0; row < height_pixels; row++)
+    {
+        for (int col = 0; col < width_pixels; col ++)
+        {
+            Pixel p = image.at(row).at(col);
+            newimg.at(col).at((height_pixels-1)-row) = p;
+
+        }
+    }
+
+    return newimg;
+}
+/*
+    Function that rotates an image 90 degrees.
+    * @param filename is the location where the file is stored
+    @return a new rotated image.
+*/
+vector<vector<Pixel>> rotate_90(vector<vector<Pixel>> image)
+{
+
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    const KernelConfig& config = kernel_config(KERNEL_ROTATE, (long long)width_pixels * height_pixels);
+    if (config.variant == ROTATE_BLOCKED)
+    {
+        return rotate_blocked(image, config);
+    }
+    // defines a new image withe strucutre pixels and rotated.
+    vector<vector<Pixel>> newimg(width_pixels, vector<Pixel>(height_pixels));
+    //Pixel newpixel;
+    // same as proc 4 above.
+    for (int row = 0; row < height_pixels; row++)
+    {
+        for (int col = 0; col < width_pixels; col ++)
+        {
+            Pixel p = image.at(row).at(col);
+            newimg.at(col).at((height_pixels-1)-row) = p;
+
+        }
+    }
+    return newimg;
+}
+/*
+    Function that reduces a number of 90 degree turns to one turn.
+    Negative counts turn the other way, so -1 is the same as 3.
+    * @param number is the number of clockwise turns
+    @return the same rotation as 0, 1, 2 or 3 turns
+*/
+int quarter_turns(int number)
+{
+    return (number % 4 + 4) % 4;
+}
+
+/*
+    Function that rotates an image in 90 degree incremenets.
+    * @param image is the image to filter
+    * @param number is the amount of times the image will be rotated 90 degrees.
+    @return a new rotated image.
+*/
+vector<vector<Pixel>> proc5(const vector<vector<Pixel>>& image, int number)
+{
+
+    // conditionals to rotate 90 degrees based on number of rotations. 
+    int turns = quarter_turns(number);
+    if (turns == 0)
+    {
+        return image;
+    }
+    else if (turns == 1)
+    {
+        return rotate_90(image);
+    }
+    else if (turns == 2)
+    {
+        return rotate_90(rotate_90(image));
+    }
+    else
+    {
+      return rotate_90(rotate_90(rotate_90(image)));  
+    }
+}
+/*
+    Function that enlarges an image.
+    * @param image is the image to filter
+    @param yscale specifies how much the height needs to change
+    @param xscale specifies how much the width needs to change
+    @return a new enlarged image.
+*/
+vector<vector<Pixel>> proc6(const vector<vector<Pixel>>& image, int xscale, int yscale)
+{
+
+    // Check if the image is valid (not empty)
+    if (image.empty()) {
+        cout << "Error: Image could not be read or is empty!" << endl;
+        return image; // Returning the empty image
+    }
+
+    // Check for valid scaling factors
+    if (xscale <= 0 || yscale <= 0) {
+        cout << "Error: Scaling factors must be positive non-zero integers!" << endl;
+        return image; // Returning the original image
+    }// Check if the image is valid (not empty)
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    //set up a new image space scaled 
+    vector<vector<Pixel>> newimg(height_pixels*yscale, vector<Pixel>(width_pixels*xscale));
+    // sets each pixel of the new image to the scalled image.
+    for (int row =0; row < height_pixels*yscale;row++)
+    {
+        for(int col =0; col < width_pixels*xscale; col++ )
+        {
+            Pixel p = image.at(row/yscale).at(col/xscale);
+            newimg[row][col] =p;
+        }
+    }
+
+    return newimg;
+}
+/*
+    Function that changes an image to a black and white image. 
+    * @param image is the image to filter
+    @return a new high contrast B/W image.
+*/
+vector<vector<Pixel>> proc7(const vector<vector<Pixel>>& img)
+{
+    int width_pixels=img[0].size();
+    int height_pixels=img.size();
+    Pixel newpixel;
+    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
+    for (int row=0; row<height_pixels;row++)
+    {
+        for (int col = 0; col<width_pixels;col++)
+        {
+            Pixel p = img.at(row).at(col);
+            int red = p.red;
+            int blue =p.blue;
+            int green =p.green;
+            // get grey value
+            int gray = (red+green+blue)/3;
+            // if light, make white. 
+            if (gray>= 255/2)
+            {
+                int newred =255;
+                int newgreen =255;
+                int newblue =255;
+                newpixel= {newred,newgreen,newblue};
+                newimg[row][col]=newpixel;
+            }
+            // if not light, make black.
+            else
+            {
+                newpixel={0,0,0};
+                newimg[row][col]=newpixel;
+            }
+        }
+    }
+
+    return newimg;
+}
+/*
+    Function that lightens an image.
+    * @param image is the image to filter
+    @param scaling_facotr is how much lighter an image should be.
+    @return a new lighter image.
+*/
+vector<vector<Pixel>> proc8(const vector<vector<Pixel>>& img, double scaling_factor)
+{
+    // new image based on the size of the input image.
+    int width_pixels = img[0].size();
+    int height_pixels = img.size();
+    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
+    Pixel newpixel;
+    for (int row=0; row<height_pixels; row++)
+    {
+        for (int col=0; col < width_pixels; col++)
+        {
+            Pixel p = img[row][col];
+            int red = p.red;
+            int green = p.green;
+            int blue = p.blue;
+            // applying scaling factor to lighten
+            int newred = (255-(255-red)*scaling_factor);
+            int newgreen =(255-(255-green)*scaling_factor);
+            int newblue=(255-(255-blue)*scaling_factor);
+            newpixel = {newred,newgreen,newblue} ;
+            newimg[row][col]=newpixel;
+        }
+    }
+
+    return newimg;
+}
+/*
+    Function that darkens an image.
+    * @param image is the image to filter
+    @param scaling_facotr is how much darker an image should be.
+    @return a new darker image.
+*/
+vector<vector<Pixel>> proc9(const vector<vector<Pixel>>& image,double scaling_factor)
+{
+ // new image based on size of existing image.
+ int width_pixels = image[0].size();
+ int height_pixels = image.size();
+ vector<vector<Pixel>> newimg(height_pixels,vector<Pixel>(width_pixels));
+ Pixel newpixel;
+ for (int row =0; row <height_pixels;row++)
+ {
+    for (int col  = 0; col<width_pixels;col++)
+    {
+        Pixel P = image[row][col];
+        int red = P.red;
+        int green = P.green;
+        int blue = P.blue;
+        // darkens pixels based on scaling factor.
+        int newred = red*scaling_factor;
+        int newgreen = green*scaling_factor;
+        int newblue = blue*scaling_factor;
+        newpixel= {newred,newgreen,newblue};
+        newimg[row][col]= newpixel;
+
+    }
+ }
+    return newimg;
+}
+/*
+    Function that changes an image only using black, white, red, green, and blue colors.
+    * @param image is the image to filter
+    @return a new colored image.
+*/
+vector<vector<Pixel>> proc10 (const vector<vector<Pixel>>& image)
+{
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    vector<vector<Pixel>> newimg(height_pixels,vector<Pixel> (width_pixels));
+    Pixel newpixel;
+    for (int row =0; row<height_pixels; row++)
+    {
+        for (int col =0; col < width_pixels; col++)
+        {
+            Pixel p= image[row][col];
+            //getting color of each pixel
+            int red =p.red;
+            int green=p.green;
+            int blue = p.blue;
+            // new paramaters
+            int newred;
+            int newblue;
+            int newgreen;
+            // conditions for loops
+            int max_color= max((red),max((green),(blue)));
+            int sum_color = red+green+blue;
+            // if light, make white. 
+            if (sum_color >= 550)
+            {
+                newred =255;
+                newblue = 255;
+                newgreen = 255;
+                newpixel={newred,newgreen,newblue};
+                newimg[row][col]= newpixel;
+            }
+            // if dark, make black. 
+            else if (sum_color <=150)
+            {
+                newred =0;
+                newblue=0;
+                newgreen=0;
+                newpixel={newred,newgreen,newblue};
+                newimg[row][col]= newpixel;
+            }
+            // if red, keep as red.
+            else if (max_color==red)
+            {
+                newred=255;
+                newblue=0;
+                newgreen=0;
+                newpixel={newred,newgreen,newblue};
+                newimg[row][col]= newpixel;
+
+            }
+            // of green, keep as green. 
+            else if (max_color==green)
+            {
+                newred = 0;
+                newgreen =255;
+                newblue = 0;
+                newpixel={newred,newgreen,newblue};
+                newimg[row][col]= newpixel;
+            }
+            // if blue, keep blue.
+            else 
+            {
+                newred=0;
+                newblue=255;
+                newgreen=0;
+                newpixel={newred,newgreen,newblue};
+                newimg[row][col]= newpixel;
+            }
+
+
+        }
+    }
+
+    return newimg;
+}
+
+
+// Resampling methods for resample_image()
+const int RESAMPLE_BOX = 1;
+const int RESAMPLE_BILINEAR = 2;
+const int RESAMPLE_LANCZOS = 3;
+
+// Resampling weights are fixed point with RESAMPLE_BITS fraction bits.
+// The horizontal pass keeps RESAMPLE_EXTRA_BITS of precision for the vertical pass.
+const int RESAMPLE_BITS = 14;
+const int RESAMPLE_EXTRA_BITS = 7;
+
+// Precomputed filter taps for every output column (or row) of a resample
+struct ResampleWeights
+{
+    // first source index and number of taps for each output position
+    vector<int> first;
+    vector<int> count;
+    // max_taps weights per output position, unused taps are zero
+    vector<int> weights;
+    int max_taps;
+};
+
+/*
+    Function that evaluates a resampling filter.
+    * @param method is RESAMPLE_BILINEAR or RESAMPLE_LANCZOS
+    @param x is the distance from the filter center in source pixels
+    @return the filter weight at x
+*/
+double resample_kernel(int method, double x)
+{
+    x = fabs(x);
+    if (method == RESAMPLE_BILINEAR)
+    {
+        return x < 1.0 ? 1.0 - x : 0.0;
+    }
+    // Lanczos with three lobes
+    if (x < 1e-8)
+    {
+        return 1.0;
+    }
+    if (x >= 3.0)
+    {
+        return 0.0;
+    }
+    double px = M_PI * x;
+    return 3.0 * sin(px) * sin(px / 3.0) / (px * px);
+}
+
+/*
+    Function that precomputes the fixed-point weight table for one axis.
+    When downscaling the filter is widened by the scale so every source
+    pixel contributes (area averaging for the box filter).
+    * @param src_size is the number of source pixels along the axis
+    @param dst_size is the number of output pixels along the axis
+    @param method is one of the RESAMPLE_ constants
+    @return the weight table
+*/
+ResampleWeights resample_weights(int src_size, int dst_size, int method)
+{
+    double scale = (double)src_size / dst_size;
+    double filter_scale = max(1.0, scale);
+    double support = filter_scale;
+    if (method == RESAMPLE_BOX)
+    {
+        support = 0.5 * filter_scale;
+    }
+    else if (method == RESAMPLE_LANCZOS)
+    {
+        support = 3.0 * filter_scale;
+    }
+
+    ResampleWeights table;
+    table.max_taps = (int)ceil(2 * support) + 2;
+    table.first.resize(dst_size);
+    table.count.resize(dst_size);
+    table.weights.assign(dst_size * table.max_taps, 0);
+    vector<double> taps(table.max_taps);
+    for (int out = 0; out < dst_size; out++)
+    {
+        // center of the output pixel in source coordinates
+        double center = (out + 0.5) * scale;
+        int first = max(0, (int)floor(center - support));
+        int last = min(src_size - 1, (int)ceil(center + support));
+        double total = 0;
+        int count = 0;
+        for (int i = first; i <= last && count < table.max_taps; i++, count++)
+        {
+            if (method == RESAMPLE_BOX)
+            {
+                // overlap of the source pixel with the output footprint
+                double left = max((double)i, center - support);
+                double right = min(i + 1.0, center + support);
+                taps[count] = max(0.0, right - left);
+            }
+            else
+            {
+                taps[count] = resample_kernel(method, (i + 0.5 - center) / filter_scale);
+            }
+            total += taps[count];
+        }
+
+        // normalize so the fixed-point weights sum to exactly one
+        int one = 1 << RESAMPLE_BITS;
+        int sum = 0;
+        int largest = 0;
+        int* weights = &table.weights[out * table.max_taps];
+        for (int k = 0; k < count; k++)
+        {
+            weights[k] = (int)lround(taps[k] / total * one);
+            sum += weights[k];
+            if (weights[k] > weights[largest])
+            {
+                largest = k;
+            }
+        }
+        weights[largest] += one - sum;
+        table.first[out] = first;
+        table.count[out] = count;
+    }
+    return table;
+}
+
+/*
+    Function that resamples an image to an arbitrary size.
+    The filter is applied separably: a horizontal pass into a fixed-point
+    buffer, then a vertical pass that accumulates whole rows at a time so
+    the inner loop is a contiguous multiply-add the compiler vectorizes.
+    Both passes are split across threads by rows.
+    * @param image is the image to resample
+    @param new_width is the output width in pixels
+    @param new_height is the output height in pixels
+    @param method is one of the RESAMPLE_ constants
+    @return a new resampled image.
+*/
+vector<vector<Pixel>> resample_image(const vector<vector<Pixel>>& image, int new_width, int new_height, int method)
+{
+    if (image.empty() || new_width <= 0 || new_height <= 0)
+    {
+        return {};
+    }
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    ResampleWeights columns = resample_weights(width_pixels, new_width, method);
+    ResampleWeights rows = resample_weights(height_pixels, new_height, method);
+    int threads = kernel_config(KERNEL_RESAMPLE, (long long)width_pixels * height_pixels).threads;
+
+    // horizontal pass, three channels per output column
+    int stride = new_width * 3;
+    int shift = RESAMPLE_BITS - RESAMPLE_EXTRA_BITS;
+    vector<int> buffer((size_t)height_pixels * stride);
+    parallel_for(height_pixels, [&](int begin, int end)
+    {
+        for (int row = begin; row < end; row++)
+        {
+            const vector<Pixel>& src = image[row];
+            int* dst = &buffer[(size_t)row * stride];
+            for (int col = 0; col < new_width; col++)
+            {
+                const int* weights = &columns.weights[col * columns.max_taps];
+                const Pixel* p = &src[columns.first[col]];
+                int red = 0;
+                int green = 0;
+                int blue = 0;
+                for (int k = 0; k < columns.count[col]; k++)
+                {
+                    red += weights[k] * p[k].red;
+                    green += weights[k] * p[k].green;
+                    blue += weights[k] * p[k].blue;
+                }
+                dst[col*3] = (red + (1 << (shift - 1))) >> shift;
+                dst[col*3+1] = (green + (1 << (shift - 1))) >> shift;
+                dst[col*3+2] = (blue + (1 << (shift - 1))) >> shift;
+            }
+        }
+    }, threads);
+
+    // vertical pass
+    vector<vector<Pixel>> newimg(new_height, vector<Pixel>(new_width));
+    shift = RESAMPLE_BITS + RESAMPLE_EXTRA_BITS;
+    parallel_for(new_height, [&](int begin, int end)
+    {
+        vector<int> sum(stride);
+        for (int row = begin; row < end; row++)
+        {
+            fill(sum.begin(), sum.end(), 1 << (shift - 1));
+            const int* weights = &rows.weights[row * rows.max_taps];
+            for (int k = 0; k < rows.count[row]; k++)
+            {
+                const int* src = &buffer[(size_t)(rows.first[row] + k) * stride];
+                int weight = weights[k];
+                for (int i = 0; i < stride; i++)
+                {
+                    sum[i] += weight * src[i];
+                }
+            }
+            for (int col = 0; col < new_width; col++)
+            {
+                newimg[row][col].red = min(255, max(0, sum[col*3] >> shift));
+                newimg[row][col].green = min(255, max(0, sum[col*3+1] >> shift));
+                newimg[row][col].blue = min(255, max(0, sum[col*3+2] >> shift));
+            }
+        }
+    }, threads);
+    return newimg;
+}
+
+/*
+    Function that resizes an image to any width and height.
+    * @param image is the image to filter
+    @param new_width is the output width in pixels
+    @param new_height is the output height in pixels
+    @param method is one of the RESAMPLE_ constants
+    @return a new resized image.
+*/
+vector<vector<Pixel>> proc11(const vector<vector<Pixel>>& image, int new_width, int new_height, int method)
+{
+    if (image.empty()) {
+        cout << "Error: Image could not be read or is empty!" << endl;
+        return image;
+    }
+    return resample_image(image, new_width, new_height, method);
+}
+
+/*
+    Function that makes several thumbnails from one decode.
+    A mip pyramid is built by halving with the box filter, and each
+    thumbnail is resampled from the smallest level that is still at
+    least as large as it.
+    * @param image is the image to filter
+    @param sizes is the longest side of each thumbnail in pixels
+    @param method is the filter used for the final resample
+    @return one thumbnail per size, in the same order as sizes.
+*/
+vector<vector<vector<Pixel>>> proc12(const vector<vector<Pixel>>& image, const vector<int>& sizes, int method)
+{
+    vector<vector<vector<Pixel>>> thumbnails(sizes.size());
+    if (image.empty()) {
+        cout << "Error: Image could not be read or is empty!" << endl;
+        return {};
+    }
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    int longest = max(width_pixels, height_pixels);
+    // the current pyramid level, starting with the image itself
+    const vector<vector<Pixel>>* level = &image;
+    vector<vector<Pixel>> halved;
+
+    // largest thumbnails first so the pyramid only ever shrinks
+    vector<int> order(sizes.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](int a, int b) { return sizes[a] > sizes[b]; });
+
+    for (int i : order)
+    {
+        int new_width = max(1, (int)lround((double)width_pixels * sizes[i] / longest));
+        int new_height = max(1, (int)lround((double)height_pixels * sizes[i] / longest));
+        while ((int)(*level)[0].size() / 2 >= new_width && (int)level->size() / 2 >= new_height)
+        {
+            halved = resample_image(*level, (*level)[0].size() / 2, level->size() / 2, RESAMPLE_BOX);
+            level = &halved;
+        }
+        thumbnails[i] = resample_image(*level, new_width, new_height, method);
+    }
+    return thumbnails;
+}
+
+// Blur radius (sigma) used by the sharpen filter
+const double SHARPEN_SIGMA = 1.0;
+
+/*
+    Function that clamps an index to the edge of an image.
+    * @param index is the row or column
+    @param size is the number of rows or columns
+    @return the nearest index inside the image
+*/
+int clamp_index(int index, int size)
+{
+    return min(size - 1, max(0, index));
+}
+
+/*
+    Function that gets the box radius for a Gaussian blur.
+    Three box blurs of width d have the variance (d*d - 1) / 4 of a Gaussian.
+    * @param sigma is the Gaussian radius in pixels
+    @return the radius of each of the three boxes
+*/
+int blur_box_radius(double sigma)
+{
+    double width = sqrt(4 * sigma * sigma + 1);
+    return max(1, (int)lround((width - 1) / 2));
+}
+
+/*
+    Function that adds up a sliding window of values, so the cost per
+    value does not depend on the radius.
+    Each position holds stride values, one per channel.
+    * @param in is the input, it must be valid for positions [lo - radius, hi + radius)
+    @param out is where the window sums of positions [lo, hi) are stored
+    @param lo is the first position to sum
+    @param hi is one past the last position to sum
+    @param radius is the window radius
+    @param stride is the number of values per position
+*/
+void box_sum_pass(const long long* in, long long* out, int lo, int hi, int radius, int stride)
+{
+    vector<long long> sum(stride, 0);
+    for (int t = lo - radius; t <= lo + radius; t++)
+    {
+        const long long* src = in + (size_t)t * stride;
+        for (int i = 0; i < stride; i++)
+        {
+            sum[i] += src[i];
+        }
+    }
+    for (int p = lo; p < hi; p++)
+    {
+        long long* dst = out + (size_t)p * stride;
+        for (int i = 0; i < stride; i++)
+        {
+            dst[i] = sum[i];
+        }
+        if (p + 1 < hi)
+        {
+            const long long* enter = in + (size_t)(p + radius + 1) * stride;
+            const long long* leave = in + (size_t)(p - radius) * stride;
+            for (int i = 0; i < stride; i++)
+            {
+                sum[i] += enter[i] - leave[i];
+            }
+        }
+    }
+}
+
+/*
+    Function that blurs columns [x0, x1) of one row with three box passes.
+    The row is extended by replicating its edge pixels, so the result is
+    the row convolved with three box kernels.
+    * @param row is the source row
+    @param x0 is the first column
+    @param x1 is one past the last column
+    @param radius is the radius of each box
+    @param out receives (x1 - x0) * 3 unnormalized sums
+    @param a is scratch space reused between rows
+    @param b is scratch space reused between rows
+*/
+void blur_line(const vector<Pixel>& row, int x0, int x1, int radius, long long* out, vector<long long>& a, vector<long long>& b)
+{
+    int width = row.size();
+    int halo = 3 * radius;
+    int count = x1 - x0 + 2 * halo;
+    a.resize(count * 3);
+    b.resize(count * 3);
+    for (int e = 0; e < count; e++)
+    {
+        const Pixel& p = row[clamp_index(x0 - halo + e, width)];
+        a[e*3] = p.red;
+        a[e*3+1] = p.green;
+        a[e*3+2] = p.blue;
+    }
+    // each pass leaves radius fewer valid values at each end
+    box_sum_pass(a.data(), b.data(), radius, count - radius, radius, 3);
+    box_sum_pass(b.data(), a.data(), 2 * radius, count - 2 * radius, radius, 3);
+    box_sum_pass(a.data(), b.data(), halo, count - halo, radius, 3);
+    copy(b.begin() + halo * 3, b.begin() + (count - halo) * 3, out);
+}
+
+// Three box sums running down the rows of an image
+struct BoxCascade
+{
+    int radius;
+    // values per row
+    int stride;
+    // for each box: the last 2 * radius + 1 rows it was given, their sum
+    // and how many rows it has been given
+    vector<long long> rings[3];
+    vector<long long> sums[3];
+    long long seen[3];
+};
+
+/*
+    Function that sets up three empty running box sums.
+    * @param radius is the radius of each box
+    @param stride is the number of values per row
+    @return the box sums
+*/
+BoxCascade make_box_cascade(int radius, int stride)
+{
+    BoxCascade cascade;
+    cascade.radius = radius;
+    cascade.stride = stride;
+    for (int box = 0; box < 3; box++)
+    {
+        cascade.rings[box].assign((size_t)(2 * radius + 1) * stride, 0);
+        cascade.sums[box].assign(stride, 0);
+        cascade.seen[box] = 0;
+    }
+    return cascade;
+}
+
+/*
+    Function that gives the next row to three running box sums, each one
+    feeding the next. A row costs the same for every radius: it is added
+    to each sum, and the row that leaves the window is taken out.
+    * @param cascade is the box sums
+    @param row is the next row of stride values
+    @return the sums of the three boxes around the row given 3 * radius
+    rows ago, or nullptr until 6 * radius + 1 rows have been given
+*/
+const long long* push_row(BoxCascade& cascade, const long long* row)
+{
+    int window = 2 * cascade.radius + 1;
+    int stride = cascade.stride;
+    for (int box = 0; box < 3 && row != nullptr; box++)
+    {
+        // the ring starts out zero, so the first rows take nothing out
+        long long* slot = &cascade.rings[box][(size_t)(cascade.seen[box] % window) * stride];
+        long long* sum = cascade.sums[box].data();
+        for (int i = 0; i < stride; i++)
+        {
+            sum[i] += row[i] - slot[i];
+            slot[i] = row[i];
+        }
+        cascade.seen[box]++;
+        row = cascade.seen[box] >= window ? sum : nullptr;
+    }
+    return row;
+}
+
+/*
+    Function that sharpens one color value with an unsharp mask.
+    * @param original is the color value
+    @param blurred is the blurred color value
+    @param amount is the sharpening amount in 1/256ths
+    @return the sharpened color value
+*/
+int sharpen_value(int original, int blurred, int amount)
+{
+    return min(255, max(0, original + (original - blurred) * amount / 256));
+}
+
+/*
+    Function that gets the Sobel gradient magnitude.
+    * @param gx is the horizontal gradient
+    @param gy is the vertical gradient
+    @return the edge strength from 0 to 255
+*/
+int edge_value(int gx, int gy)
+{
+    return min(255, (int)sqrt((double)gx * gx + (double)gy * gy));
+}
+
+/*
+    Function that runs the separable horizontal half of the Sobel
+    operator on columns [x0, x1) of the gray values of one row.
+    * @param row is the source row
+    @param x0 is the first column
+    @param x1 is one past the last column
+    @param diff receives the [-1 0 1] derivative
+    @param smooth receives the [1 2 1] smoothing
+*/
+void edge_line(const vector<Pixel>& row, int x0, int x1, int* diff, int* smooth)
+{
+    int width = row.size();
+    for (int x = x0; x < x1; x++)
+    {
+        const Pixel& left = row[clamp_index(x - 1, width)];
+        const Pixel& center = row[x];
+        const Pixel& right = row[clamp_index(x + 1, width)];
+        // same gray value as proc3
+        int gray_left = (left.red + left.green + left.blue) / 3;
+        int gray_center = (center.red + center.green + center.blue) / 3;
+        int gray_right = (right.red + right.green + right.blue) / 3;
+        diff[x - x0] = gray_right - gray_left;
+        smooth[x - x0] = gray_left + 2 * gray_center + gray_right;
+    }
+}
+
+/*
+    Function that turns the box sums of one row into blurred (13) or
+    sharpened (14) pixels.
+    * @param sums is the row of sums from push_row()
+    @param original is the row before it was blurred
+    @param choice is 13 or 14
+    @param radius is the box radius
+    @param amount is the sharpening amount in 1/256ths
+    @param dst is where the row of pixels is stored
+*/
+void blur_pixels(const long long* sums, const vector<Pixel>& original, int choice, int radius, int amount, Pixel* dst)
+{
+    long long width = 2 * radius + 1;
+    long long total = width * width * width * width * width * width;
+    for (size_t x = 0; x < original.size(); x++)
+    {
+        int red = (sums[x*3] + total / 2) / total;
+        int green = (sums[x*3+1] + total / 2) / total;
+        int blue = (sums[x*3+2] + total / 2) / total;
+        if (choice == 14)
+        {
+            red = sharpen_value(original[x].red, red, amount);
+            green = sharpen_value(original[x].green, green, amount);
+            blue = sharpen_value(original[x].blue, blue, amount);
+        }
+        dst[x] = {red, green, blue};
+    }
+}
+
+/*
+    Function that runs the three-box blur over a band of whole rows.
+    Each row is blurred across once and then goes through the running
+    box sums down the rows, so the cost does not depend on the radius.
+    Rows are visited one way (step 1 or -1), and rows past the top or
+    bottom of the image repeat the edge row.
+    * @param y0 is the first output row
+    @param count is the number of output rows
+    @param step is 1 to go down the image, -1 to go up it
+    @param height is the height of the image
+    @param radius is the radius of each box
+    @param get_row gives a source row, called in visiting order
+    @param emit is given each output row and its box sums, in visiting order
+*/
+void blur_rows(int y0, int count, int step, int height, int radius,
+               const function<const vector<Pixel>&(int)>& get_row, const function<void(int, const long long*)>& emit)
+{
+    int halo = 3 * radius;
+    BoxCascade cascade;
+    vector<long long> line;
+    vector<long long> line_a;
+    vector<long long> line_b;
+    int last_y = -1;
+    for (int k = 0; k < count + 2 * halo; k++)
+    {
+        int y = clamp_index(y0 + (k - halo) * step, height);
+        // the edge rows repeat, and are only blurred across once
+        if (y != last_y)
+        {
+            const vector<Pixel>& row = get_row(y);
+            if (line.empty())
+            {
+                line.resize(row.size() * 3);
+                cascade = make_box_cascade(radius, line.size());
+            }
+            blur_line(row, 0, row.size(), radius, line.data(), line_a, line_b);
+            last_y = y;
+        }
+        const long long* sums = push_row(cascade, line.data());
+        if (sums != nullptr)
+        {
+            emit(y0 + (k - 2 * halo) * step, sums);
+        }
+    }
+}
+
+/*
+    Function that runs the Sobel operator over a band of whole rows,
+    keeping the horizontal halves of the last three rows.
+    * @param y0 is the first output row
+    @param count is the number of output rows
+    @param step is 1 to go down the image, -1 to go up it
+    @param height is the height of the image
+    @param get_row gives a source row, called in visiting order
+    @param emit is given each output row of pixels, in visiting order
+*/
+void edge_rows(int y0, int count, int step, int height,
+               const function<const vector<Pixel>&(int)>& get_row, const function<void(int, const Pixel*)>& emit)
+{
+    vector<vector<int>> diff(3);
+    vector<vector<int>> smooth(3);
+    vector<Pixel> out;
+    for (int k = 0; k < count + 2; k++)
+    {
+        const vector<Pixel>& row = get_row(clamp_index(y0 + (k - 1) * step, height));
+        int width = row.size();
+        diff[k % 3].resize(width);
+        smooth[k % 3].resize(width);
+        edge_line(row, 0, width, diff[k % 3].data(), smooth[k % 3].data());
+        if (k < 2)
+        {
+            continue;
+        }
+        // the rows above and below the output row, whichever way the rows are visited
+        int up = (step > 0 ? k - 2 : k) % 3;
+        int down = (step > 0 ? k : k - 2) % 3;
+        int mid = (k - 1) % 3;
+        out.resize(width);
+        for (int x = 0; x < width; x++)
+        {
+            int gx = diff[up][x] + 2 * diff[mid][x] + diff[down][x];
+            int gy = smooth[down][x] - smooth[up][x];
+            int edge = edge_value(gx, gy);
+            out[x] = {edge, edge, edge};
+        }
+        emit(y0 + (k - 2) * step, out.data());
+    }
+}
+
+/*
+    Function that applies a neighbourhood filter with one band of whole
+    rows per thread. Only the 3 * radius rows above and below each band
+    are blurred across twice.
+    * @param image is the image to filter
+    @param choice is 13 (blur), 14 (sharpen) or 15 (edge detection)
+    @param radius is the box radius for blur and sharpen
+    @param amount is the sharpening amount in 1/256ths
+    @return the filtered image.
+*/
+vector<vector<Pixel>> convolve_image(const vector<vector<Pixel>>& image, int choice, int radius, int amount)
+{
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
+    const KernelConfig& config = kernel_config(KERNEL_CONVOLUTION, (long long)width_pixels * height_pixels);
+    auto get_row = [&](int y) -> const vector<Pixel>& { return image[y]; };
+    parallel_for(height_pixels, [&](int begin, int end)
+    {
+        if (choice == 15)
+        {
+            edge_rows(begin, end - begin, 1, height_pixels, get_row, [&](int y, const Pixel* row)
+            {
+                copy(row, row + width_pixels, newimg[y].begin());
+            });
+        }
+        else
+        {
+            blur_rows(begin, end - begin, 1, height_pixels, radius, get_row, [&](int y, const long long* sums)
+            {
+                blur_pixels(sums, image[y], choice, radius, amount, newimg[y].data());
+            });
+        }
+    }, config.threads);
+    return newimg;
+}
+
+/*
+    Function that blurs an image.
+    The Gaussian is approximated by three box blurs, so the cost does not
+    depend on the radius.
+    * @param image is the image to filter
+    @param sigma is the blur radius in pixels
+    @return a new blurred image.
+*/
+vector<vector<Pixel>> proc13(const vector<vector<Pixel>>& image, double sigma)
+{
+    return convolve_image(image, 13, blur_box_radius(sigma), 0);
+}
+
+/*
+    Function that sharpens an image with an unsharp mask.
+    * @param image is the image to filter
+    @param amount is how much of the detail to add back, 1 doubles it
+    @return a new sharpened image.
+*/
+vector<vector<Pixel>> proc14(const vector<vector<Pixel>>& image, double amount)
+{
+    return convolve_image(image, 14, blur_box_radius(SHARPEN_SIGMA), (int)lround(amount * 256));
+}
+
+/*
+    Function that finds the edges of an image with the Sobel operator.
+    * @param image is the image to filter
+    @return a new gray image, brighter where the edges are stronger.
+*/
+vector<vector<Pixel>> proc15(const vector<vector<Pixel>>& image)
+{
+    return convolve_image(image, 15, 1, 0);
+}
+
+// Operation number of a tone curve, which the planner makes from lighten and darken
+const int TONE_CURVE = 16;
+
+/*
+    Function that maps every color value through a tone curve.
+    * @param image is the image to filter
+    @param curve is the new value of each of the 256 color values
+    @return a new image with the curve applied.
+*/
+vector<vector<Pixel>> apply_tone_curve(const vector<vector<Pixel>>& image, const vector<int>& curve)
+{
+    int width_pixels = image[0].size();
+    int height_pixels = image.size();
+    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
+    for (int row = 0; row < height_pixels; row++)
+    {
+        for (int col = 0; col < width_pixels; col++)
+        {
+            const Pixel& p = image[row][col];
+            newimg[row][col] = {curve[p.red], curve[p.green], curve[p.blue]};
+        }
+    }
+    return newimg;
+}
+
+/*
+    Function that builds a metadata index of every BMP in a directory.
+    Only the headers are read, in parallel, and the index is sorted from
+    the largest image to the smallest so jobs can be scheduled by size.
+    * @param directory is the directory to scan (recursively)
+    @param index_filename is the CSV file to write the index to
+    @return the number of images indexed, or -1 on error
+*/
+int index_directory(const string& directory, const string& index_filename)
+{
+    vector<string> paths;
+    error_code error;
+    // unreadable subdirectories are skipped, not an error for the whole scan
+    filesystem::directory_options options = filesystem::directory_options::skip_permission_denied;
+    for (filesystem::recursive_directory_iterator it(directory, options, error), end; !error && it != end; it.increment(error))
+    {
+        string extension = it->path().extension().string();
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (it->is_regular_file() && extension == ".bmp")
+        {
+            paths.push_back(it->path().string());
+        }
+    }
+    if (error)
+    {
+        cout << "Error: could not scan " << directory << ": " << error.message() << endl;
+        return -1;
+    }
+
+    // each thread probes its own block of files
+    vector<BmpInfo> infos(paths.size());
+    parallel_for(paths.size(), [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            infos[i] = probe_image(paths[i]);
+        }
+    });
+
+    // largest images first, ties broken by path for a stable index
+    vector<int> order(paths.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](int a, int b)
+    {
+        long long pixels_a = (long long)infos[a].width * infos[a].height;
+        long long pixels_b = (long long)infos[b].width * infos[b].height;
+        if (pixels_a != pixels_b)
+        {
+            return pixels_a > pixels_b;
+        }
+        return paths[a] < paths[b];
+    });
+
+    fstream stream;
+    stream.open(index_filename, ios::out);
+    if (!stream.is_open())
+    {
+        cout << "Error: could not write " << index_filename << endl;
+        return -1;
+    }
+    stream << "path,valid,width,height,bits_per_pixel,pixels,file_size" << endl;
+    for (int i : order)
+    {
+        const BmpInfo& info = infos[i];
+        stream << paths[i] << "," << info.valid << "," << info.width << "," << info.height << ","
+               << info.bits_per_pixel << "," << (long long)info.width * info.height << ","
+               << info.file_size << endl;
+    }
+    stream.close();
+    return paths.size();
+}
+
+// Allocation counters shared by every thread, updated by operator new and delete
+atomic<long long> live_bytes(0);
+atomic<long long> peak_bytes(0);
+atomic<long long> allocation_count(0);
+atomic<long long> allocated_bytes(0);
+
+// Each allocation stores its size in front of the memory handed out
+const size_t ALLOCATION_HEADER = alignof(max_align_t);
+
+/*
+    Replacement for the global operator new that counts every allocation,
+    so the image buffers of each job can be reported.
+*/
+void* operator new(size_t size)
+{
+    char* block = (char*)malloc(size + ALLOCATION_HEADER);
+    if (block == nullptr)
+    {
+        throw bad_alloc();
+    }
+    *(size_t*)block = size;
+    allocation_count++;
+    allocated_bytes += size;
+    long long live = live_bytes += size;
+    long long peak = peak_bytes;
+    while (live > peak && !peak_bytes.compare_exchange_weak(peak, live))
+    {
+    }
+    return block + ALLOCATION_HEADER;
+}
+
+void operator delete(void* memory) noexcept
+{
+    if (memory == nullptr)
+    {
+        return;
+    }
+    // go through an integer so the compiler does not treat this as indexing before the block
+    void* block = (void*)((uintptr_t)memory - ALLOCATION_HEADER);
+    live_bytes -= *(size_t*)block;
+    free(block);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+// Allocation totals for one stage of a job (decode, filter, encode ...)
+struct StageStats
+{
+    string name;
+    long long allocations;
+    long long bytes;
+    long long peak;
+};
+
+// Stages of the job that is running
+vector<StageStats> job_stages;
+
+// Largest predicted job footprint in bytes before a job streams or is rejected, 0 for no limit
+long long memory_budget = 0;
+
+/*
+    Function that starts counting allocations for a new job stage.
+    * @param name is the name of the stage in the report
+*/
+void begin_stage(const string& name)
+{
+    StageStats stage = {name, allocation_count, allocated_bytes, 0};
+    job_stages.push_back(stage);
+    peak_bytes = live_bytes.load();
+}
+
+/*
+    Function that stops counting allocations for the current job stage.
+*/
+void end_stage()
+{
+    StageStats& stage = job_stages.back();
+    stage.allocations = allocation_count - stage.allocations;
+    stage.bytes = allocated_bytes - stage.bytes;
+    stage.peak = peak_bytes;
+}
+
+/*
+    Function that formats a number of bytes in megabytes.
+    * @param bytes is the number of bytes
+    @return the size with two decimals, like "1.50 MB"
+*/
+string megabytes(long long bytes)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.2f MB", bytes / (1024.0 * 1024.0));
+    return text;
+}
+
+/*
+    Function that prints the allocations of every stage of the last job
+    and starts a new job.
+    * @param predicted is the footprint predicted from the header
+*/
+void report_memory(long long predicted)
+{
+    long long job_peak = 0;
+    cout << "Memory usage:" << endl;
+    for (const StageStats& stage : job_stages)
+    {
+        cout << "  " << stage.name << ": " << stage.allocations << " allocations, "
+             << megabytes(stage.bytes) << " allocated, peak " << megabytes(stage.peak) << endl;
+        job_peak = max(job_peak, stage.peak);
+    }
+    cout << "  Job peak " << megabytes(job_peak) << " (predicted " << megabytes(predicted)
+         << "), " << megabytes(live_bytes) << " still live" << endl;
+    job_stages.clear();
+}
+
+// One filter from the menu together with the parameters it was given
+struct Operation
+{
+    int choice = 0;
+    double scaling_factor = 0;
+    int rotation_number = 0;
+    int x_scale = 1;
+    int y_scale = 1;
+    int new_width = 0;
+    int new_height = 0;
+    int method = RESAMPLE_BOX;
+    vector<int> thumbnail_sizes;
+    double radius = 0;
+    double amount = 0;
+    // 256 entries for a TONE_CURVE
+    vector<int> curve;
+};
+
+/*
+    Function that gets how far blur, sharpen or edge detection reads
+    around an output pixel.
+    * @param op is the filter (13, 14 or 15) and its parameters
+    @return the number of pixels read on each side
+*/
+int convolution_reach(const Operation& op)
+{
+    if (op.choice == 15)
+    {
+        return 1;
+    }
+    // three box blurs in a row
+    return 3 * blur_box_radius(op.choice == 13 ? op.radius : SHARPEN_SIGMA);
+}
+
+/*
+    Function that filters an image one band of rows per task.
+    * @param image is the image to filter
+    @param config is the band height and thread count to use
+    @param filter filters one band, given the row of the full image it starts at
+    @return the filtered image.
+*/
+vector<vector<Pixel>> apply_in_bands(const vector<vector<Pixel>>& image, const KernelConfig& config,
+                                     const function<vector<vector<Pixel>>(const vector<vector<Pixel>>&, int)>& filter)
+{
+    int height_pixels = image.size();
+    int band_rows = max(1, config.block_height);
+    int bands = (height_pixels + band_rows - 1) / band_rows;
+    vector<vector<Pixel>> newimg(height_pixels);
+    parallel_for(bands, [&](int begin, int end)
+    {
+        for (int band = begin; band < end; band++)
+        {
+            int first = band * band_rows;
+            int last = min(height_pixels, first + band_rows);
+            vector<vector<Pixel>> rows = filter(vector<vector<Pixel>>(image.begin() + first, image.begin() + last), first);
+            for (int row = first; row < last; row++)
+            {
+                newimg[row].swap(rows[row - first]);
+            }
+        }
+    }, config.threads);
+    return newimg;
+}
+
+/*
+    Function that applies one filter to an image in memory.
+    Filters that only look at one row at a time run in bands of rows on
+    several threads when the pixel kernel is tuned to.
+    Thumbnails (12) make several images and are not handled here.
+    * @param op is the filter and its parameters
+    @param image is the image to filter
+    @param first_row is the row of the full image that image starts at
+    @param full_height is the height of the full image when image is only a band of it
+    @param first_col is the column of the full image that image starts at
+    @param full_width is the width of the full image when image is only a region of it
+    @return the filtered image.
+*/
+vector<vector<Pixel>> apply_operation(const Operation& op, const vector<vector<Pixel>>& image, int first_row = 0, int full_height = 0,
+                                      int first_col = 0, int full_width = 0)
+{
+    bool row_local = op.choice == 1 || op.choice == 2 || op.choice == 3 || (op.choice >= 7 && op.choice <= 10) || op.choice == TONE_CURVE;
+    if (row_local && full_height == 0 && !image.empty())
+    {
+        const KernelConfig& config = kernel_config(KERNEL_PIXEL, (long long)image[0].size() * image.size());
+        if (config.threads != 1 && (int)image.size() > config.block_height)
+        {
+            int height_pixels = image.size();
+            return apply_in_bands(image, config, [&](const vector<vector<Pixel>>& band, int first)
+            {
+                return apply_operation(op, band, first, height_pixels);
+            });
+        }
+    }
+    switch (op.choice) {
+        case 1:
+            return proc1(image, first_row, full_height, first_col, full_width);
+        case 2:
+            return proc2(image, op.scaling_factor);
+        case 3:
+            return proc3(image);
+        case 4:
+            return proc4(image);
+        case 5:
+            return proc5(image, op.rotation_number);
+        case 6:
+            return proc6(image, op.x_scale, op.y_scale);
+        case 7:
+            return proc7(image);
+        case 8:
+            return proc8(image, op.scaling_factor);
+        case 9:
+            return proc9(image, op.scaling_factor);
+        case 10:
+            return proc10(image);
+        case 11:
+            return proc11(image, op.new_width, op.new_height, op.method);
+        case 13:
+            return proc13(image, op.radius);
+        case 14:
+            return proc14(image, op.amount);
+        case 15:
+            return proc15(image);
+        case TONE_CURVE:
+            return apply_tone_curve(image, op.curve);
+        default:
+            return image;
+    }
+}
+
+/*
+    Function that parses a filter chain from the command line.
+    Filters are separated by commas, and each is a menu number followed
+    by its parameters in the order the menu asks for them, separated by
+    colons. For example "3,8:0.5,6:2:2,11:640:480:3".
+    Thumbnails (12) are not allowed because they make several images.
+    * @param text is the filter chain
+    @param ops receives the filters
+    @param out is where the reason a chain is not valid is printed
+    @return false (after printing the reason) if the chain is not valid
+*/
+bool parse_operations(const string& text, vector<Operation>& ops, ostream& out = cout)
+{
+    stringstream chain(text);
+    string item;
+    while (getline(chain, item, ','))
+    {
+        vector<double> values;
+        stringstream fields(item);
+        string field;
+        while (getline(fields, field, ':'))
+        {
+            char* end = nullptr;
+            values.push_back(strtod(field.c_str(), &end));
+            if (field.empty() || *end != '\0')
+            {
+                out << "Error: " << item << " is not a number list" << endl;
+                return false;
+            }
+        }
+        // menu numbers, turns, scales and sizes are whole numbers that fit in an int
+        auto whole = [](double value)
+        {
+            return value == floor(value) && value >= numeric_limits<int>::min() && value <= numeric_limits<int>::max();
+        };
+        Operation op;
+        op.choice = values.empty() || !whole(values[0]) ? 0 : (int)values[0];
+        // number of parameters each filter takes
+        size_t expected = 1;
+        if (op.choice == 2 || op.choice == 5 || op.choice == 8 || op.choice == 9 || op.choice == 13 || op.choice == 14)
+        {
+            expected = 2;
+        }
+        else if (op.choice == 6)
+        {
+            expected = 3;
+        }
+        else if (op.choice == 11)
+        {
+            expected = 4;
+        }
+        if (op.choice < 1 || op.choice > 15 || op.choice == 12 || values.size() != expected)
+        {
+            out << "Error: " << item << " is not a filter this chain can run" << endl;
+            return false;
+        }
+        size_t whole_values = op.choice == 5 || op.choice == 6 || op.choice == 11 ? values.size() : 1;
+        for (size_t i = 1; i < whole_values; i++)
+        {
+            if (!whole(values[i]))
+            {
+                out << "Error: the parameters of " << item << " must be whole numbers between " << numeric_limits<int>::min() << " and " << numeric_limits<int>::max() << endl;
+                return false;
+            }
+        }
+        bool valid = true;
+        if (op.choice == 2 || op.choice == 8 || op.choice == 9)
+        {
+            op.scaling_factor = values[1];
+            valid = op.scaling_factor >= 0.0 && op.scaling_factor <= 1.0;
+        }
+        else if (op.choice == 5)
+        {
+            op.rotation_number = (int)values[1];
+        }
+        else if (op.choice == 6)
+        {
+            op.y_scale = (int)values[1];
+            op.x_scale = (int)values[2];
+            valid = op.y_scale > 0 && op.x_scale > 0;
+        }
+        else if (op.choice == 11)
+        {
+            op.new_width = (int)values[1];
+            op.new_height = (int)values[2];
+            op.method = (int)values[3];
+            valid = op.new_width > 0 && op.new_height > 0 && op.method >= RESAMPLE_BOX && op.method <= RESAMPLE_LANCZOS;
+        }
+        else if (op.choice == 13)
+        {
+            op.radius = values[1];
+            valid = op.radius >= 1.0 && op.radius <= 50.0;
+        }
+        else if (op.choice == 14)
+        {
+            op.amount = values[1];
+            valid = op.amount >= 0.0 && op.amount <= 5.0;
+        }
+        if (!valid)
+        {
+            out << "Error: the parameters of " << item << " are out of range" << endl;
+            return false;
+        }
+        ops.push_back(op);
+    }
+    if (ops.empty())
+    {
+        out << "Error: the filter chain is empty" << endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Function that describes an operation for a printed plan.
+    * @param op is the filter and its parameters
+    @return a short description
+*/
+string describe_operation(const Operation& op)
+{
+    stringstream text;
+    switch (op.choice) {
+        case 1: text << "vignette"; break;
+        case 2: text << "clarendon " << op.scaling_factor; break;
+        case 3: text << "grayscale"; break;
+        case 4: text << "rotate 90 degrees"; break;
+        case 5: text << "rotate 90 degrees " << op.rotation_number << " times"; break;
+        case 6: text << "enlarge height x" << op.y_scale << ", width x" << op.x_scale; break;
+        case 7: text << "high contrast"; break;
+        case 8: text << "lighten " << op.scaling_factor; break;
+        case 9: text << "darken " << op.scaling_factor; break;
+        case 10: text << "black, white, red, green, blue"; break;
+        case 11: text << "resize to " << op.new_width << "x" << op.new_height; break;
+        case 13: text << "blur " << op.radius; break;
+        case 14: text << "sharpen " << op.amount; break;
+        case 15: text << "edge detect"; break;
+        case TONE_CURVE: text << "tone curve"; break;
+        default: text << "filter " << op.choice; break;
+    }
+    return text.str();
+}
+
+/*
+    Function that gets the tone curve of lighten, darken or a tone curve.
+    The curve repeats the integer math of proc8 and proc9 exactly.
+    * @param op is a lighten (8), darken (9) or TONE_CURVE operation
+    @return the new value of each of the 256 color values
+*/
+vector<int> tone_curve(const Operation& op)
+{
+    if (op.choice == TONE_CURVE)
+    {
+        return op.curve;
+    }
+    vector<int> curve(256);
+    for (int value = 0; value < 256; value++)
+    {
+        if (op.choice == 8)
+        {
+            curve[value] = (255-(255-value)*op.scaling_factor);
+        }
+        else
+        {
+            curve[value] = value*op.scaling_factor;
+        }
+    }
+    return curve;
+}
+
+/*
+    Function that rewrites a filter chain into fewer passes that give the
+    same image.
+    Pixel filters (2, 3, 7 to 10) only look at one pixel, so they commute
+    with rotations and enlargements. Between the filters that do not
+    (vignette, resize, blur, sharpen, edge detect) the plan runs the pixel
+    filters first, then one rotation, then one enlargement:
+    - rotations add up modulo 360 degrees, and a whole turn is dropped
+    - enlargements multiply, with their scales swapped when an odd number
+      of quarter turns is moved past them
+    - neighbouring lighten and darken filters become one tone curve, and
+      a curve that changes nothing is dropped
+    - repeated grayscale, high contrast or five color filters run once,
+      and grayscale before high contrast is dropped
+    * @param ops is the requested filter chain
+    @return the equivalent plan, empty if the chain changes nothing
+*/
+vector<Operation> optimize_plan(const vector<Operation>& ops)
+{
+    vector<Operation> plan;
+    size_t start = 0;
+    while (start <= ops.size())
+    {
+        // a segment ends at a filter that does not commute with rotations
+        size_t end = start;
+        while (end < ops.size() && ((ops[end].choice >= 2 && ops[end].choice <= 10) || ops[end].choice == TONE_CURVE))
+        {
+            end++;
+        }
+
+        int turns = 0;
+        for (size_t i = start; i < end; i++)
+        {
+            // reduced first so a long chain of large counts cannot overflow
+            turns = quarter_turns(turns + (ops[i].choice == 4 ? 1 : (ops[i].choice == 5 ? quarter_turns(ops[i].rotation_number) : 0)));
+        }
+
+        vector<Operation> pixel_ops;
+        int turns_before = 0;
+        int x_scale = 1;
+        int y_scale = 1;
+        for (size_t i = start; i < end; i++)
+        {
+            const Operation& op = ops[i];
+            if (op.choice == 4 || op.choice == 5)
+            {
+                turns_before = quarter_turns(turns_before + (op.choice == 4 ? 1 : quarter_turns(op.rotation_number)));
+                continue;
+            }
+            if (op.choice == 6)
+            {
+                // moving the rotations after this one in front of it swaps its axes
+                bool swapped = quarter_turns(turns - turns_before) % 2 != 0;
+                x_scale *= swapped ? op.y_scale : op.x_scale;
+                y_scale *= swapped ? op.x_scale : op.y_scale;
+                continue;
+            }
+            bool is_curve = op.choice == 8 || op.choice == 9 || op.choice == TONE_CURVE;
+            Operation* last = pixel_ops.empty() ? nullptr : &pixel_ops.back();
+            bool last_curve = last && (last->choice == 8 || last->choice == 9 || last->choice == TONE_CURVE);
+            if (is_curve && last_curve)
+            {
+                vector<int> first = tone_curve(*last);
+                vector<int> second = tone_curve(op);
+                for (int& value : first)
+                {
+                    value = second[value];
+                }
+                last->choice = TONE_CURVE;
+                last->curve = first;
+            }
+            else if (last && last->choice == op.choice && (op.choice == 3 || op.choice == 7 || op.choice == 10))
+            {
+                // these filters give the same image when run again
+            }
+            else if (last && last->choice == 3 && op.choice == 7)
+            {
+                // grayscale keeps the average high contrast uses
+                *last = op;
+            }
+            else
+            {
+                pixel_ops.push_back(op);
+            }
+        }
+
+        for (const Operation& op : pixel_ops)
+        {
+            bool is_curve = op.choice == 8 || op.choice == 9 || op.choice == TONE_CURVE;
+            vector<int> curve = is_curve ? tone_curve(op) : vector<int>();
+            bool identity = is_curve;
+            for (int value = 0; value < (int)curve.size(); value++)
+            {
+                identity = identity && curve[value] == value;
+            }
+            if (!identity)
+            {
+                plan.push_back(op);
+            }
+        }
+        if (turns != 0)
+        {
+            Operation rotation;
+            rotation.choice = turns == 1 ? 4 : 5;
+            rotation.rotation_number = turns;
+            plan.push_back(rotation);
+        }
+        if (x_scale != 1 || y_scale != 1)
+        {
+            Operation enlargement;
+            enlargement.choice = 6;
+            enlargement.x_scale = x_scale;
+            enlargement.y_scale = y_scale;
+            plan.push_back(enlargement);
+        }
+        if (end < ops.size())
+        {
+            plan.push_back(ops[end]);
+        }
+        start = end + 1;
+    }
+    return plan;
+}
+
+/*
+    Function that prints a plan and how many passes it saves.
+    * @param ops is the requested filter chain
+    @param plan is the optimized plan
+    @param out is the stream to print to
+*/
+void print_plan(const vector<Operation>& ops, const vector<Operation>& plan, ostream& out)
+{
+    out << "Requested " << ops.size() << " passes:";
+    for (const Operation& op : ops)
+    {
+        out << " [" << describe_operation(op) << "]";
+    }
+    out << endl << "Optimized to " << plan.size() << " passes:";
+    for (const Operation& op : plan)
+    {
+        out << " [" << describe_operation(op) << "]";
+    }
+    if (plan.empty())
+    {
+        out << " copy the input";
+    }
+    out << endl << "Saved " << ops.size() - plan.size() << " passes" << endl;
+}
+
+/*
+    Function that gets the size of the image an operation produces.
+    * @param op is the filter and its parameters
+    @param width is the input width, replaced by the output width
+    @param height is the input height, replaced by the output height
+*/
+void output_size(const Operation& op, int& width, int& height)
+{
+    if (op.choice == 4 || (op.choice == 5 && op.rotation_number % 2 != 0))
+    {
+        swap(width, height);
+    }
+    else if (op.choice == 6)
+    {
+        width = width * op.x_scale;
+        height = height * op.y_scale;
+    }
+    else if (op.choice == 11)
+    {
+        width = op.new_width;
+        height = op.new_height;
+    }
+}
+
+/*
+    Function that gets the bytes used by an image held as vectors of Pixels.
+    * @param width is the width in pixels
+    @param height is the height in pixels
+    @return the heap bytes of the image
+*/
+long long image_bytes(long long width, long long height)
+{
+    return height * (width * sizeof(Pixel) + sizeof(vector<Pixel>));
+}
+
+/*
+    Function that predicts the peak memory of a job from the image header.
+    * @param info is the probed input image
+    @param op is the filter and its parameters
+    @return the predicted peak in bytes
+*/
+long long predict_job_bytes(const BmpInfo& info, const Operation& op)
+{
+    int width = info.width;
+    int height = info.height;
+    output_size(op, width, height);
+    long long input = image_bytes(info.width, info.height);
+    long long output = image_bytes(width, height);
+    if (op.choice == 5)
+    {
+        // rotate_90 copies its argument, and nested calls keep those copies
+        // until the whole expression is done
+        output += 2 * input;
+    }
+    else if (op.choice == 11)
+    {
+        // fixed-point buffer between the horizontal and vertical pass
+        output += (long long)info.height * op.new_width * 3 * sizeof(int);
+    }
+    else if (op.choice == 13 || op.choice == 14)
+    {
+        // each thread keeps three rings of 2 * radius + 1 rows of sums, and a few more rows
+        int radius = blur_box_radius(op.choice == 13 ? op.radius : SHARPEN_SIGMA);
+        const KernelConfig& config = kernel_config(KERNEL_CONVOLUTION, (long long)info.width * info.height);
+        long long sums = (3LL * (2 * radius + 1) + 6) * info.width * 3 * sizeof(long long);
+        int threads = config.threads > 0 ? config.threads : thread::hardware_concurrency();
+        output += sums * max(1, threads);
+    }
+    else if (op.choice == 12)
+    {
+        // first pyramid level and its resample buffer, plus the thumbnails themselves
+        output = input / 4 + (long long)info.height * (info.width / 2) * 3 * sizeof(int);
+        int longest = max(info.width, info.height);
+        for (int size : op.thumbnail_sizes)
+        {
+            output += image_bytes((long long)info.width * size / longest + 1, (long long)info.height * size / longest + 1);
+        }
+    }
+    // compressed files are held in memory while they are decoded
+    long long decode = input;
+    if (info.compression == BI_RLE8 || info.compression == BI_RLE4)
+    {
+        decode += info.file_size;
+    }
+    return max(decode, input + output);
+}
+
+/*
+    Function that checks if a filter only needs the rows it writes, so it
+    can run on a band of rows at a time.
+    * @param info is the probed input image, which must be uncompressed 24 or 32 bit
+    @param choice is the filter number from the menu
+    @return true if the filter can be streamed
+*/
+bool is_streamable(const BmpInfo& info, int choice)
+{
+    if (info.bits_per_pixel < 24 || info.compression != BI_RGB)
+    {
+        return false;
+    }
+    return choice == 1 || choice == 2 || choice == 3 || choice == 6 || (choice >= 7 && choice <= 10) || choice >= 13;
+}
+
+// True to run-length encode palette outputs (BI_RLE4 / BI_RLE8)
+bool use_rle = false;
+
+/*
+    Function that gets the colors a filter can produce, so its output can
+    be saved as a smaller palette BMP.
+    * @param choice is the filter number from the menu
+    @return the palette, or an empty vector for full color output
+*/
+vector<Pixel> output_palette(int choice)
+{
+    vector<Pixel> palette;
+    if (choice == 3 || choice == 15)
+    {
+        // 256 gray levels
+        for (int gray = 0; gray < 256; gray++)
+        {
+            palette.push_back({gray, gray, gray});
+        }
+    }
+    else if (choice == 7)
+    {
+        palette = {{0, 0, 0}, {255, 255, 255}};
+    }
+    else if (choice == 10)
+    {
+        palette = {{0, 0, 0}, {255, 255, 255}, {255, 0, 0}, {0, 255, 0}, {0, 0, 255}};
+    }
+    return palette;
+}
+
+/*
+    Function that checks if a file name asks for a raw image.
+    * @param filename is the file name
+    @return true if it ends with .raw
+*/
+bool is_raw_filename(const string& filename)
+{
+    return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".raw") == 0;
+}
+
+/*
+    Function that saves a filtered image: as a raw image for a .raw name,
+    otherwise as a BMP with 1, 4 or 8 bits per pixel when the filter has
+    a known palette, and 24 bits when it does not.
+    * @param filename is the file to write
+    @param image is the image to save
+    @param choice is the last filter that changed the colors
+    @return true if successful and false otherwise
+*/
+bool save_image(const string& filename, const vector<vector<Pixel>>& image, int choice)
+{
+    if (is_raw_filename(filename))
+    {
+        return write_raw_image(filename, image);
+    }
+    vector<Pixel> palette = output_palette(choice);
+    if (!palette.empty() && write_indexed_image(filename, image, palette, use_rle))
+    {
+        return true;
+    }
+    return write_image_parallel(filename, image);
+}
+
+/*
+    Function that applies a filter a band of rows at a time, so only one
+    band of the input and output is ever in memory.
+    Bands are taken from the bottom of the image so the file is read and
+    written in order. Filters with a known palette are written as a palette
+    BMP like save_image() does, but never run-length encoded.
+    * @param op is a streamable filter and its parameters
+    @param info is the probed input image
+    @param filename is the input image
+    @param output_filename is the BMP file to write
+    @return true if the output was written
+*/
+bool stream_operation(const Operation& op, const BmpInfo& info, const string& filename, const string& output_filename)
+{
+    int width_pixels = info.width;
+    int height_pixels = info.height;
+    int out_width = width_pixels;
+    int out_height = height_pixels;
+    output_size(op, out_width, out_height);
+    int rows_per_row = out_height / height_pixels;
+
+    int bytes_per_pixel = info.bits_per_pixel / 8;
+    int in_row = width_pixels * bytes_per_pixel + (4 - width_pixels * bytes_per_pixel % 4) % 4;
+    vector<Pixel> palette = output_palette(op.choice);
+    int out_bits = palette.empty() ? 24 : palette_bits(palette.size());
+    int out_row = scanline_bytes(out_width, out_bits);
+
+    fstream input;
+    input.open(filename, ios::in | ios::binary);
+    fstream output;
+    output.open(output_filename, ios::out | ios::binary);
+    if (!input.is_open() || !output.is_open())
+    {
+        return false;
+    }
+    unsigned char header[BMP_PROBE_SIZE];
+    make_header(header, out_width, out_height, out_bits, palette.size(), BI_RGB, out_row * out_height);
+    output.write((char*)header, BMP_PROBE_SIZE);
+    vector<unsigned char> palette_bytes = encode_palette(palette);
+    output.write((char*)palette_bytes.data(), palette_bytes.size());
+    unordered_map<int, int> lookup = palette_lookup(palette);
+    vector<unsigned char> indices(out_width);
+
+    // as many rows per band as fit in half the budget
+    long long row_cost = image_bytes(width_pixels, 1) + in_row + (image_bytes(out_width, 1) + out_row) * rows_per_row;
+    int band_rows = 64;
+    if (memory_budget > 0)
+    {
+        band_rows = max(1LL, min((long long)height_pixels, memory_budget / 2 / row_cost));
+    }
+
+    vector<unsigned char> raw;
+    vector<unsigned char> encoded;
+    input.seekg(info.start);
+    for (int end = height_pixels; end > 0; end -= band_rows)
+    {
+        int first = max(0, end - band_rows);
+        int rows = end - first;
+        raw.resize((size_t)rows * in_row);
+        input.read((char*)raw.data(), raw.size());
+        if (!input)
+        {
+            return false;
+        }
+
+        // the last row of the band comes first in the file
+        vector<vector<Pixel>> band(rows, vector<Pixel>(width_pixels));
+        for (int row = 0; row < rows; row++)
+        {
+            const unsigned char* src = &raw[(size_t)(rows - 1 - row) * in_row];
+            for (int col = 0; col < width_pixels; col++)
+            {
+                band[row][col].blue = src[col * bytes_per_pixel];
+                band[row][col].green = src[col * bytes_per_pixel + 1];
+                band[row][col].red = src[col * bytes_per_pixel + 2];
+            }
+        }
+        vector<vector<Pixel>> newband = apply_operation(op, band, first, height_pixels);
+
+        encoded.assign((size_t)newband.size() * out_row, 0);
+        for (size_t row = 0; row < newband.size(); row++)
+        {
+            unsigned char* dst = &encoded[(newband.size() - 1 - row) * out_row];
+            if (!palette.empty())
+            {
+                if (!palette_indices(newband[row].data(), out_width, lookup, indices.data()))
+                {
+                    return false;
+                }
+                pack_indices(indices.data(), out_width, out_bits, dst);
+                continue;
+            }
+            for (int col = 0; col < out_width; col++)
+            {
+                dst[col * 3] = newband[row][col].blue;
+                dst[col * 3 + 1] = newband[row][col].green;
+                dst[col * 3 + 2] = newband[row][col].red;
+            }
+        }
+        output.write((char*)encoded.data(), encoded.size());
+    }
+    output.close();
+    return !output.fail();
+}
+
+/*
+    Function that streams blur, sharpen or edge detection through a ring
+    of rows. Only the rows the kernel reaches are kept in memory, and the
+    result is the same as convolve_image(). Edge detection is written as an
+    8 bit gray BMP like save_image() does.
+    * @param op is the filter (13, 14 or 15) and its parameters
+    @param info is the probed input image, uncompressed 24 or 32 bit
+    @param filename is the input image
+    @param output_filename is the BMP file to write
+    @return true if the output was written
+*/
+bool stream_convolution(const Operation& op, const BmpInfo& info, const string& filename, const string& output_filename)
+{
+    int width_pixels = info.width;
+    int height_pixels = info.height;
+    long long in_row = scanline_bytes(width_pixels, info.bits_per_pixel);
+    bool edges = op.choice == 15;
+    vector<Pixel> palette = output_palette(op.choice);
+    int out_bits = palette.empty() ? 24 : palette_bits(palette.size());
+    long long out_row = scanline_bytes(width_pixels, out_bits);
+    int radius = blur_box_radius(op.choice == 13 ? op.radius : SHARPEN_SIGMA);
+    int amount = (int)lround(op.amount * 256);
+    // rows below an output row that are read before it is written
+    int reach = convolution_reach(op);
+    int slots = reach + 1;
+
+    fstream input;
+    input.open(filename, ios::in | ios::binary);
+    fstream output;
+    output.open(output_filename, ios::out | ios::binary);
+    if (!input.is_open() || !output.is_open())
+    {
+        return false;
+    }
+    unsigned char header[BMP_PROBE_SIZE];
+    make_header(header, width_pixels, height_pixels, out_bits, palette.size(), BI_RGB, out_row * height_pixels);
+    output.write((char*)header, BMP_PROBE_SIZE);
+    vector<unsigned char> palette_bytes = encode_palette(palette);
+    output.write((char*)palette_bytes.data(), palette_bytes.size());
+    unordered_map<int, int> lookup = palette_lookup(palette);
+    vector<unsigned char> indices(width_pixels);
+    bool encode_ok = true;
+
+    // ring of decoded rows indexed by image row % slots
+    vector<vector<Pixel>> rows(slots, vector<Pixel>(width_pixels));
+    vector<unsigned char> raw(in_row);
+    vector<unsigned char> encoded(out_row, 0);
+    vector<Pixel> filtered(width_pixels);
+    vector<Pixel> no_palette;
+    bool read_ok = true;
+
+    // the file starts with the bottom row, so rows are read and written bottom to top
+    input.seekg(info.start);
+    int next = height_pixels - 1;
+    auto get_row = [&](int y) -> const vector<Pixel>&
+    {
+        while (read_ok && next >= y)
+        {
+            input.read((char*)raw.data(), raw.size());
+            read_ok = (bool)input;
+            decode_pixels(raw.data(), info.bits_per_pixel, no_palette, 0, width_pixels, rows[next % slots].data());
+            next--;
+        }
+        return rows[y % slots];
+    };
+    auto write_row = [&](const Pixel* row)
+    {
+        if (!palette.empty())
+        {
+            encode_ok = palette_indices(row, width_pixels, lookup, indices.data()) && encode_ok;
+            pack_indices(indices.data(), width_pixels, out_bits, encoded.data());
+            output.write((char*)encoded.data(), encoded.size());
+            return;
+        }
+        for (int x = 0; x < width_pixels; x++)
+        {
+            encoded[x*3] = row[x].blue;
+            encoded[x*3+1] = row[x].green;
+            encoded[x*3+2] = row[x].red;
+        }
+        output.write((char*)encoded.data(), encoded.size());
+    };
+
+    if (edges)
+    {
+        edge_rows(height_pixels - 1, height_pixels, -1, height_pixels, get_row, [&](int, const Pixel* row)
+        {
+            write_row(row);
+        });
+    }
+    else
+    {
+        blur_rows(height_pixels - 1, height_pixels, -1, height_pixels, radius, get_row, [&](int y, const long long* sums)
+        {
+            // the ring still holds row y, the last row read is 3 * radius above it
+            blur_pixels(sums, get_row(y), op.choice, radius, amount, filtered.data());
+            write_row(filtered.data());
+        });
+    }
+    output.close();
+    return read_ok && encode_ok && !output.fail();
+}
+
+// Region of interest for every job, zero width for the whole image
+Region roi = {0, 0, 0, 0};
+// True to write the filtered region over a copy of the full input instead of a cropped output
+bool roi_patch = false;
+
+/*
+    Function that saves a filtered region over a copy of the full input.
+    Uncompressed 24 and 32 bit inputs are copied and patched in place, any
+    other input is decoded, pasted into and saved as 24 bit.
+    * @param filename is the input image
+    @param info is the probed input image
+    @param region is where the filtered pixels go
+    @param patch is the filtered pixels, the same size as region
+    @param output_filename is the BMP file to write
+    @return true if the output was written
+*/
+bool save_patched(const string& filename, const BmpInfo& info, const Region& region, const vector<vector<Pixel>>& patch, const string& output_filename)
+{
+    if (info.bits_per_pixel >= 24 && info.compression == BI_RGB)
+    {
+        error_code error;
+        filesystem::copy_file(filename, output_filename, filesystem::copy_options::overwrite_existing, error);
+        return !error && patch_image(output_filename, patch, region.x, region.y);
+    }
+    vector<vector<Pixel>> image = load_image(filename);
+    if (image.empty())
+    {
+        return false;
+    }
+    for (int row = 0; row < region.height; row++)
+    {
+        copy(patch[row].begin(), patch[row].end(), image[region.y + row].begin() + region.x);
+    }
+    return write_image_parallel(output_filename, image);
+}
+
+/*
+    Function that runs one filter job from decode to the saved output and
+    reports the memory it used.
+    With a memory budget set, a job predicted to go over it is streamed
+    if the filter allows it and rejected otherwise.
+    With a region of interest set, only that rectangle, and the pixels
+    around it a blur, sharpen or edge detection reaches, is decoded and
+    filtered, and it is saved cropped or patched into the full image.
+    * @param op is the filter and its parameters
+    @param filename is the input image
+    @param output_filename is the BMP file to write
+    @return true if the output was saved
+*/
+bool run_job(const Operation& op, const string& filename, const string& output_filename)
+{
+    BmpInfo info = probe_image(filename);
+    if (!info.valid)
+    {
+        cout << "Error: Image could not be read or is empty!" << endl;
+        return false;
+    }
+
+    // a region of interest is processed as an image of its own
+    bool use_roi = roi.width > 0 && roi.height > 0;
+    Region region = clip_region(roi, info);
+    // the part of the image decoded for the region
+    Region source = region;
+    BmpInfo job_info = info;
+    if (use_roi)
+    {
+        if (region.width == 0 || region.height == 0)
+        {
+            cout << "Error: the region is outside the image!" << endl;
+            return false;
+        }
+        int width = region.width;
+        int height = region.height;
+        output_size(op, width, height);
+        if (roi_patch && (op.choice == 12 || width != region.width || height != region.height))
+        {
+            cout << "Error: only filters that keep the size of the region can patch it!" << endl;
+            return false;
+        }
+        // blur, sharpen and edge detection also read the pixels around the
+        // region, so its edges come out the same as in the full image
+        if (op.choice >= 13)
+        {
+            int reach = convolution_reach(op);
+            source = clip_region({region.x - reach, region.y - reach, region.width + 2 * reach, region.height + 2 * reach}, info);
+        }
+        job_info.width = source.width;
+        job_info.height = source.height;
+    }
+
+    long long predicted = predict_job_bytes(job_info, op);
+    bool saved = true;
+    if (memory_budget > 0 && predicted > memory_budget)
+    {
+        if (use_roi || !is_streamable(info, op.choice))
+        {
+            cout << "Error: this job needs about " << megabytes(predicted) << ", over the memory budget of "
+                 << megabytes(memory_budget) << endl;
+            return false;
+        }
+        cout << "This job needs about " << megabytes(predicted) << ", over the memory budget of "
+             << megabytes(memory_budget) << ". Streaming it instead." << endl;
+        begin_stage("stream");
+        if (op.choice >= 13)
+        {
+            saved = stream_convolution(op, info, filename, output_filename);
+        }
+        else
+        {
+            saved = stream_operation(op, info, filename, output_filename);
+        }
+        end_stage();
+        cout << (saved ? "Successfully saved " : "Error: could not save ") + output_filename<<endl;
+        report_memory(predicted);
+        return saved;
+    }
+
+    begin_stage("decode");
+    vector<vector<Pixel>> image = use_roi ? load_image_roi(filename, source) : load_image(filename);
+    end_stage();
+    if (image.empty())
+    {
+        cout << "Error: Image could not be read or is empty!" << endl;
+        job_stages.clear();
+        return false;
+    }
+
+    begin_stage("filter");
+    vector<vector<Pixel>> newimage;
+    vector<vector<vector<Pixel>>> thumbnails;
+    if (op.choice == 12)
     {
-        for (int col = 0; col < width_pixels; col ++)
+        thumbnails = proc12(image, op.thumbnail_sizes, op.method);
+    }
+    else if (use_roi)
+    {
+        // position-dependent filters (vignette) see where the region sits in the image
+        newimage = apply_operation(op, image, source.y, info.height, source.x, info.width);
+        if (source.width != region.width || source.height != region.height)
         {
-            Pixel p = image[row][col];
-            int red = p.red;
-            int blue =p.blue;
-            int green = p.green;
-            int average = (red+green+blue)/3;
-            int newred;
-            int newblue;
-            int newgreen;
-            // if the cell is light, make it lighter.
-            if (average >= 170)
-            {
-                newred = (255 - (255-red)*scaling_factor);
-                newblue = (255 - (255-blue)*scaling_factor);
-                newgreen = (255 - (255-green)*scaling_factor);
-                newpixel = {newred,newgreen,newblue};
-                newimg[row][col] = newpixel;
-
-            }
-            // if pixel is dark, scale to make darker
-            else if (average < 90)
-            {
-                newred= red*scaling_factor;
-                newblue= blue*scaling_factor;
-                newgreen= green*scaling_factor;
-                newpixel = {newred,newgreen,newblue};
-                newimg[row][col] = newpixel;
-            }
-            // if cell isnt light or dark, keep.
-            else 
+            // keep only the region out of the pixels around it
+            vector<vector<Pixel>> crop(region.height);
+            for (int row = 0; row < region.height; row++)
             {
-                int newred= red;
-                int newblue= blue;
-                int newgreen= green;
-                newpixel = {newred,newgreen,newblue};
-                newimg[row][col] = newpixel;
-
+                const vector<Pixel>& src = newimage[region.y - source.y + row];
+                crop[row].assign(src.begin() + (region.x - source.x), src.begin() + (region.x - source.x) + region.width);
             }
-            
-
-
+            newimage.swap(crop);
         }
     }
-    return newimg;
+    else
+    {
+        newimage = apply_operation(op, image);
+    }
+    // the input is not needed while the output is written
+    vector<vector<Pixel>>().swap(image);
+    end_stage();
 
+    begin_stage("encode");
+    if (op.choice == 12)
+    {
+        // thumbnails are saved side by side with their size in the name
+        string base = output_filename.substr(0, output_filename.size() - 4);
+        for (const vector<vector<Pixel>>& thumbnail : thumbnails)
+        {
+            string thumbnail_filename = base + "_" + to_string(thumbnail[0].size()) + "x" + to_string(thumbnail.size()) + ".bmp";
+            bool thumbnail_saved = write_image_parallel(thumbnail_filename, thumbnail);
+            cout << (thumbnail_saved ? "Successfully saved " : "Error: could not save ") + thumbnail_filename<<endl;
+            saved = thumbnail_saved && saved;
+        }
+    }
+    else if (use_roi && roi_patch)
+    {
+        saved = save_patched(filename, info, region, newimage, output_filename);
+    }
+    else
+    {
+        saved = save_image(output_filename, newimage, op.choice);
+    }
+    if (op.choice != 12)
+    {
+        cout << (saved ? "Successfully saved " : "Error: could not save ") + output_filename<<endl;
+    }
+    end_stage();
+    vector<vector<Pixel>>().swap(newimage);
+    thumbnails.clear();
+    report_memory(predicted);
+    return saved;
 }
+
 /*
-    Function that changes the image to a grayscaled image
-    * @param filename is the location where the file is stored
-    @return a new grayscalled image.
+    Function that reads up to the given number of bytes from a file
+    descriptor, stopping early only at the end of the input.
+    * @param fd is the file descriptor
+    @param buffer is where the bytes are stored
+    @param bytes is the number of bytes to read
+    @return the number of bytes read
 */
-vector<vector<Pixel>> proc3(string filename)
+size_t read_all(int fd, unsigned char* buffer, size_t bytes)
 {
-    // Call the read_image function and return its result
-    vector<vector<Pixel>> image = read_image(filename);
-    // Getting the size of the width and heigh pixels
-    int width_pixels = image[0].size();
-    int height_pixels = image.size();
-    // defines a new image withe strucutre pixels and the same size as the orginal image 
-    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
-
-    Pixel newpixel;
-    for (int row = 0; row < height_pixels; row++)
+    size_t total = 0;
+    while (total < bytes)
     {
-        for (int col = 0; col < width_pixels; col ++)
+        ssize_t done = read(fd, buffer + total, bytes - total);
+        if (done <= 0)
         {
-            //getting a pixel at row and col
-            Pixel p =image[row][col];
-            // getting red blue and green
-            int red = p.red;
-            int blue = p.blue;
-            int green =  p.green;
-            // getting the gray shade for the pixel
-            int gray_pixel = (red+blue+green)/3;
-            // setting each color for the gray value
-            int newred = gray_pixel;
-            int newblue =gray_pixel;
-            int newgreen = gray_pixel;
-            //setting color for new pixel
-            newpixel = {newred,newblue,newgreen};
-            //setting new pixel into the new image
-            newimg[row][col] = newpixel;
-
+            break;
         }
+        total += done;
     }
-    return newimg;
-
-
+    return total;
 }
+
 /*
-    Function that rotates an image 90 degrees.
-    * @param filename is the location where the file is stored
-    @return a new rotated image.
+    Function that writes all the bytes to a file descriptor, such as a pipe.
+    * @param fd is the file descriptor
+    @param buffer is the bytes to write
+    @param bytes is the number of bytes to write
+    @return true if all the bytes were written
 */
-vector<vector<Pixel>> proc4(string filename)
+bool write_all(int fd, const unsigned char* buffer, size_t bytes)
 {
-    // Call the read_image function and return its result
-    vector<vector<Pixel>> image = read_image(filename);
-    // Getting the size of the width and heigh pixels
-    int width_pixels = image[0].size();
-    int height_pixels = image.size();
-    // defines a new image withe strucutre pixels and rotated.
-    vector<vector<Pixel>> newimg(width_pixels, vector<Pixel>(height_pixels));
-    // loop thqt switches the row and col pixels of the new image so that it rotates.
-    for (int row = 0; row < height_pixels; row++)
+    while (bytes > 0)
     {
-        for (int col = 0; col < width_pixels; col ++)
+        ssize_t done = write(fd, buffer, bytes);
+        if (done <= 0)
         {
-            Pixel p = image.at(row).at(col);
-            newimg.at(col).at((height_pixels-1)-row) = p;
-
+            return false;
         }
+        buffer += done;
+        bytes -= done;
     }
-
-    return newimg;
+    return true;
 }
+
 /*
-    Function that rotates an image 90 degrees.
-    * @param filename is the location where the file is stored
-    @return a new rotated image.
+    Function that reads the next BMP file from a stream of concatenated
+    BMP files. The size in the BMP header says where each file ends.
+    * @param fd is the file descriptor to read from
+    @param frame receives the whole file, or is left empty at the end of the input
+    @return false if the input ends inside a frame or a frame has no BMP header
 */
-vector<vector<Pixel>> rotate_90(vector<vector<Pixel>> image)
+bool read_frame(int fd, vector<unsigned char>& frame)
 {
+    frame.assign(BMP_PROBE_SIZE, 0);
+    size_t header_bytes = read_all(fd, frame.data(), BMP_PROBE_SIZE);
+    if (header_bytes != (size_t)BMP_PROBE_SIZE)
+    {
+        // nothing at all after the last frame is the end of the input
+        frame.clear();
+        return header_bytes == 0;
+    }
+    long long file_size = get_bytes(frame.data(), 2, 4);
+    if (frame[0] != 'B' || frame[1] != 'M' || file_size < BMP_PROBE_SIZE)
+    {
+        frame.clear();
+        return false;
+    }
+    frame.resize(file_size);
+    size_t rest = file_size - BMP_PROBE_SIZE;
+    if (read_all(fd, frame.data() + BMP_PROBE_SIZE, rest) != rest)
+    {
+        frame.clear();
+        return false;
+    }
+    return true;
+}
 
-    int width_pixels = image[0].size();
-    int height_pixels = image.size();
-    // defines a new image withe strucutre pixels and rotated.
-    vector<vector<Pixel>> newimg(width_pixels, vector<Pixel>(height_pixels));
-    //Pixel newpixel;
-    // same as proc 4 above.
-    for (int row = 0; row < height_pixels; row++)
+/*
+    Function that filters a sequence of BMP frames from stdin to stdout.
+    The next frame is read on another thread while the current one is
+    filtered, and the frame rate is reported on stderr.
+    * @param ops is the filter chain applied to every frame
+    @return the number of frames written, or -1 if a frame was not valid
+*/
+int run_pipe(const vector<Operation>& ops)
+{
+    auto started = chrono::steady_clock::now();
+    int frames = 0;
+    vector<unsigned char> pending;
+    future<bool> next = async(launch::async, read_frame, STDIN_FILENO, ref(pending));
+    while (true)
     {
-        for (int col = 0; col < width_pixels; col ++)
+        if (!next.get())
         {
-            Pixel p = image.at(row).at(col);
-            newimg.at(col).at((height_pixels-1)-row) = p;
+            cerr << "Error: frame " << frames << " is truncated or does not start with a BMP header" << endl;
+            return -1;
+        }
+        if (pending.empty())
+        {
+            break;
+        }
+        vector<unsigned char> frame;
+        frame.swap(pending);
+        // read frame N+1 while frame N is filtered
+        next = async(launch::async, read_frame, STDIN_FILENO, ref(pending));
 
+        vector<vector<Pixel>> image = decode_bmp(frame.data(), frame.size());
+        if (image.empty())
+        {
+            cerr << "Error: frame " << frames << " is not a valid BMP image" << endl;
+            next.wait();
+            return -1;
+        }
+        for (const Operation& op : ops)
+        {
+            image = apply_operation(op, image);
+        }
+        vector<unsigned char> data = encode_bmp(image);
+        if (!write_all(STDOUT_FILENO, data.data(), data.size()))
+        {
+            cerr << "Error: could not write frame " << frames << endl;
+            next.wait();
+            return -1;
+        }
+        frames++;
+        if (frames % 100 == 0)
+        {
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+            cerr << frames << " frames, " << frames / seconds << " frames per second" << endl;
         }
     }
-    return newimg;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    cerr << "Processed " << frames << " frames in " << seconds << " s ("
+         << (seconds > 0 ? frames / seconds : 0) << " frames per second)" << endl;
+    return frames;
 }
+
+// True to only print the plan of --run instead of running it
+bool dry_run = false;
+
 /*
-    Function that rotates an image in 90 degree incremenets.
-    * @param filename is the location where the file is stored
-    * @param number is the amount of times the image will be rotated 90 degrees.
-    @return a new rotated image.
+    Function that runs a filter chain on one image with the optimized
+    plan: one decode, the planned passes, and one encode.
+    * @param ops is the requested filter chain
+    @param filename is the input image
+    @param output_filename is the BMP or raw file to write
+    @return true if the output was saved (or the plan printed)
 */
-vector<vector<Pixel>> proc5(string filename, int number)
+bool run_plan(const vector<Operation>& ops, const string& filename, const string& output_filename)
 {
+    vector<Operation> plan = optimize_plan(ops);
+    print_plan(ops, plan, cout);
+    if (dry_run)
+    {
+        return true;
+    }
+    BmpInfo info = probe_image(filename);
+    if (!info.valid)
+    {
+        cout << "Error: Image could not be read or is empty!" << endl;
+        return false;
+    }
+    if (plan.empty())
+    {
+        // nothing changes the image, only the format can
+        bool saved;
+        if (is_raw_filename(output_filename) != (info.compression == RAW_IMAGE))
+        {
+            saved = is_raw_filename(output_filename) ? bmp_to_raw(filename, output_filename) : raw_to_bmp(filename, output_filename);
+        }
+        else
+        {
+            error_code error;
+            filesystem::copy_file(filename, output_filename, filesystem::copy_options::overwrite_existing, error);
+            saved = !error;
+        }
+        cout << (saved ? "Successfully saved " : "Error: could not save ") + output_filename<<endl;
+        return saved;
+    }
 
-    // reads image
-    vector<vector<Pixel>> image = read_image(filename);
-    // number of rotations multiplied by 90.
-    // conditionals to rotate 90 degrees based on number of rotations. 
-    int angle = (number*90);
-    if (angle%90 !=0)
+    // the largest pass sets the peak
+    long long predicted = 0;
+    BmpInfo pass_info = info;
+    for (const Operation& op : plan)
     {
-        cout << " Error: number must be a multiple of 90 degrees!";
-        return image;
+        predicted = max(predicted, predict_job_bytes(pass_info, op));
+        output_size(op, pass_info.width, pass_info.height);
+        pass_info.compression = BI_RGB;
     }
-    else if (angle%360 == 0)
+    if (memory_budget > 0 && predicted > memory_budget)
     {
-        return image;
+        cout << "Error: this plan needs about " << megabytes(predicted) << ", over the memory budget of "
+             << megabytes(memory_budget) << endl;
+        return false;
     }
-    else if (angle%360 == 90)
+
+    begin_stage("decode");
+    vector<vector<Pixel>> image = load_image(filename);
+    end_stage();
+    if (image.empty())
     {
-        return rotate_90(image);
+        cout << "Error: Image could not be read or is empty!" << endl;
+        job_stages.clear();
+        return false;
     }
-    else if (angle%360 ==180)
+    for (const Operation& op : plan)
     {
-        return rotate_90(rotate_90(image));
+        begin_stage(describe_operation(op));
+        image = apply_operation(op, image);
+        end_stage();
     }
-    else
+    begin_stage("encode");
+    // rotations and enlargements after a low-color filter add no colors
+    size_t last = plan.size() - 1;
+    while (last > 0 && plan[last].choice >= 4 && plan[last].choice <= 6)
     {
-      return rotate_90(rotate_90(rotate_90(image)));  
+        last--;
     }
-    return image;
+    bool saved = save_image(output_filename, image, plan[last].choice);
+    end_stage();
+    vector<vector<Pixel>>().swap(image);
+    cout << (saved ? "Successfully saved " : "Error: could not save ") + output_filename<<endl;
+    report_memory(predicted);
+    return saved;
 }
+
 /*
-    Function that enlarges an image.
-    * @param filename is the location where the file is stored
-    @param yscale specifies how much the height needs to change
-    @param xscale specifies how much the width needs to change
-    @return a new enlarged image.
+    Function that gets where the tuning profile is kept when --profile
+    does not name one.
+    @return the profile path in the home directory
 */
-vector<vector<Pixel>> proc6(string filename, int xscale, int yscale)
+string default_profile_path()
 {
+    const char* home = getenv("HOME");
+    return string(home != nullptr ? home : ".") + "/.shahin_tuning";
+}
 
-    vector<vector<Pixel>> image= read_image(filename);
-    // Check if the image is valid (not empty)
-    if (image.empty()) {
-        cout << "Error: Image could not be read or is empty!" << endl;
-        return image; // Returning the empty image
-    }
+// Tuning profile loaded at startup and written by --tune
+string profile_path = default_profile_path();
 
-    // Check for valid scaling factors
-    if (xscale <= 0 || yscale <= 0) {
-        cout << "Error: Scaling factors must be positive non-zero integers!" << endl;
-        return image; // Returning the original image
-    }// Check if the image is valid (not empty)
-    int width_pixels = image[0].size();
-    int height_pixels = image.size();
-    //set up a new image space scaled 
-    vector<vector<Pixel>> newimg(height_pixels*yscale, vector<Pixel>(width_pixels*xscale));
-    // sets each pixel of the new image to the scalled image.
-    for (int row =0; row < height_pixels*yscale;row++)
+/*
+    Function that loads kernel settings saved by --tune.
+    Each line is "kernel size threads variant block_width block_height";
+    lines that do not parse are skipped with a warning.
+    * @param filename is the profile file
+    @return false if there is no profile
+*/
+bool load_profile(const string& filename)
+{
+    ifstream stream(filename);
+    if (!stream.is_open())
     {
-        for(int col =0; col < width_pixels*xscale; col++ )
+        return false;
+    }
+    string line;
+    int line_number = 0;
+    while (getline(stream, line))
+    {
+        line_number++;
+        if (line.empty() || line[0] == '#')
         {
-            Pixel p = image.at(row/yscale).at(col/xscale);
-            newimg[row][col] =p;
+            continue;
+        }
+        stringstream fields(line);
+        string kernel_name;
+        string size_name;
+        KernelConfig config;
+        fields >> kernel_name >> size_name >> config.threads >> config.variant >> config.block_width >> config.block_height;
+        int kernel = find(KERNEL_NAMES, KERNEL_NAMES + KERNEL_COUNT, kernel_name) - KERNEL_NAMES;
+        int size = find(SIZE_NAMES, SIZE_NAMES + SIZE_CLASSES, size_name) - SIZE_NAMES;
+        bool valid = !fields.fail() && kernel < KERNEL_COUNT && size < SIZE_CLASSES
+            && config.threads >= 0 && config.block_width >= 0 && config.block_height >= 0;
+        if (valid && kernel == KERNEL_ROTATE)
+        {
+            valid = (config.variant == ROTATE_ROWS || config.variant == ROTATE_BLOCKED) && config.block_width > 0;
+        }
+        else if (valid && kernel == KERNEL_PIXEL)
+        {
+            valid = config.block_height > 0;
+        }
+        if (!valid)
+        {
+            cerr << "Warning: skipping line " << line_number << " of " << filename << endl;
+            continue;
         }
+        kernel_tuning[kernel][size] = config;
     }
-
-    return newimg;
+    return true;
 }
+
 /*
-    Function that changes an image to a black and white image. 
-    * @param filename is the location where the file is stored
-    @return a new high contrast B/W image.
+    Function that saves the kernel settings for later runs.
+    * @param filename is the profile file
+    @return true if successful and false otherwise
 */
-vector<vector<Pixel>> proc7(string filename)
+bool save_profile(const string& filename)
 {
-    vector<vector<Pixel>> img = read_image(filename);
-    int width_pixels=img[0].size();
-    int height_pixels=img.size();
-    Pixel newpixel;
-    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
-    for (int row=0; row<height_pixels;row++)
+    ofstream stream(filename);
+    stream << "# kernel size threads variant block_width block_height" << endl;
+    for (int kernel = 0; kernel < KERNEL_COUNT; kernel++)
     {
-        for (int col = 0; col<width_pixels;col++)
+        for (int size = 0; size < SIZE_CLASSES; size++)
         {
-            Pixel p = img.at(row).at(col);
-            int red = p.red;
-            int blue =p.blue;
-            int green =p.green;
-            // get grey value
-            int gray = (red+green+blue)/3;
-            // if light, make white. 
-            if (gray>= 255/2)
-            {
-                int newred =255;
-                int newgreen =255;
-                int newblue =255;
-                newpixel= {newred,newgreen,newblue};
-                newimg[row][col]=newpixel;
-            }
-            // if not light, make black.
-            else
-            {
-                newpixel={0,0,0};
-                newimg[row][col]=newpixel;
-            }
+            const KernelConfig& config = kernel_tuning[kernel][size];
+            stream << KERNEL_NAMES[kernel] << " " << SIZE_NAMES[size] << " " << config.threads << " "
+                   << config.variant << " " << config.block_width << " " << config.block_height << endl;
         }
     }
-
-    return newimg;
+    stream.close();
+    return !stream.fail();
 }
+
 /*
-    Function that lightens an image.
-    * @param filename is the location where the file is stored
-    @param scaling_facotr is how much lighter an image should be.
-    @return a new lighter image.
+    Function that makes an image with smooth gradients and some noise,
+    so the benchmarks see the branches real photos take.
+    * @param width is the width in pixels
+    @param height is the height in pixels
+    @return the image
 */
-vector<vector<Pixel>> proc8(string filename, double scaling_factor)
+vector<vector<Pixel>> synthetic_image(int width, int height)
 {
-    // new image based on the size of the input image.
-    vector<vector<Pixel>> img=read_image(filename);
-    int width_pixels = img[0].size();
-    int height_pixels = img.size();
-    vector<vector<Pixel>> newimg(height_pixels, vector<Pixel>(width_pixels));
-    Pixel newpixel;
-    for (int row=0; row<height_pixels; row++)
+    vector<vector<Pixel>> image(height, vector<Pixel>(width));
+    unsigned int seed = 12345;
+    for (int row = 0; row < height; row++)
     {
-        for (int col=0; col < width_pixels; col++)
+        for (int col = 0; col < width; col++)
         {
-            Pixel p = img[row][col];
-            int red = p.red;
-            int green = p.green;
-            int blue = p.blue;
-            // applying scaling factor to lighten
-            int newred = (255-(255-red)*scaling_factor);
-            int newgreen =(255-(255-green)*scaling_factor);
-            int newblue=(255-(255-blue)*scaling_factor);
-            newpixel = {newred,newgreen,newblue} ;
-            newimg[row][col]=newpixel;
+            seed = seed * 1103515245 + 12345;
+            int noise = (seed >> 16) % 32;
+            image[row][col] = {(col * 224 / width + noise) % 256, (row * 224 / height + noise) % 256,
+                               ((col + row) * 112 / (width + height) + noise) % 256};
         }
     }
+    return image;
+}
 
-    return newimg;
+/*
+    Function that times a kernel, best of a few runs.
+    * @param run runs the kernel once
+    @return the fastest run in seconds
+*/
+double time_kernel(const function<void()>& run)
+{
+    const int RUNS = 3;
+    const double TIME_LIMIT = 0.5;
+    double best = 0;
+    double total = 0;
+    for (int i = 0; i < RUNS && total < TIME_LIMIT; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        run();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best = i == 0 ? seconds : min(best, seconds);
+        total += seconds;
+    }
+    return best;
 }
+
 /*
-    Function that darkens an image.
-    * @param filename is the location where the file is stored
-    @param scaling_facotr is how much darker an image should be.
-    @return a new darker image.
+    Function that lists the settings worth timing for a kernel.
+    * @param kernel is one of the KERNEL_ constants
+    @return the candidate settings
 */
-vector<vector<Pixel>> proc9(string filename,double scaling_factor)
+vector<KernelConfig> tuning_candidates(int kernel)
 {
- // new image based on size of existing image.
- vector<vector<Pixel>> image= read_image(filename);
- int width_pixels = image[0].size();
- int height_pixels = image.size();
- vector<vector<Pixel>> newimg(height_pixels,vector<Pixel>(width_pixels));
- Pixel newpixel;
- for (int row =0; row <height_pixels;row++)
- {
-    for (int col  = 0; col<width_pixels;col++)
+    // powers of two up to the number of hardware threads, and that number
+    int hardware = max(1u, thread::hardware_concurrency());
+    vector<int> threads;
+    for (int count = 1; count < hardware; count *= 2)
     {
-        Pixel P = image[row][col];
-        int red = P.red;
-        int green = P.green;
-        int blue = P.blue;
-        // darkens pixels based on scaling factor.
-        int newred = red*scaling_factor;
-        int newgreen = green*scaling_factor;
-        int newblue = blue*scaling_factor;
-        newpixel= {newred,newgreen,newblue};
-        newimg[row][col]= newpixel;
+        threads.push_back(count);
+    }
+    threads.push_back(hardware);
 
+    vector<KernelConfig> candidates;
+    if (kernel == KERNEL_PIXEL)
+    {
+        // one thread runs the filter on the whole image
+        candidates.push_back({1, 0, 0, 64});
+        for (int count : threads)
+        {
+            for (int band : {16, 64, 256})
+            {
+                if (count > 1)
+                {
+                    candidates.push_back({count, 0, 0, band});
+                }
+            }
+        }
     }
- }
-    return newimg;
+    else if (kernel == KERNEL_ROTATE)
+    {
+        candidates.push_back({1, ROTATE_ROWS, 32, 32});
+        for (int count : threads)
+        {
+            for (int block : {16, 32, 64})
+            {
+                candidates.push_back({count, ROTATE_BLOCKED, block, block});
+            }
+        }
+    }
+    else
+    {
+        // convolution and resampling only have a thread count
+        for (int count : threads)
+        {
+            candidates.push_back({count, 0, 0, 0});
+        }
+    }
+    return candidates;
 }
+
 /*
-    Function that changes an image only using black, white, red, green, and blue colors.
-    * @param filename is the location where the file is stored
-    @return a new colored image.
+    Function that benchmarks every kernel on synthetic images of each size
+    class, keeps the fastest settings and saves them as the profile.
+    The pixel filters are timed with clarendon, convolution with blur and
+    resampling with a bilinear half-size resize.
+    * @param filename is the profile file to write
+    @return true if the profile was saved
 */
-vector<vector<Pixel>> proc10 (string filename)
+bool run_autotune(const string& filename)
 {
-    vector<vector<Pixel>> image= read_image(filename);
-    int width_pixels = image[0].size();
-    int height_pixels = image.size();
-    vector<vector<Pixel>> newimg(height_pixels,vector<Pixel> (width_pixels));
-    Pixel newpixel;
-    for (int row =0; row<height_pixels; row++)
+    // one image per size class
+    const int SAMPLE_SIZES[SIZE_CLASSES][2] = {{640, 480}, {1600, 1200}, {2400, 1800}};
+    for (int size = 0; size < SIZE_CLASSES; size++)
     {
-        for (int col =0; col < width_pixels; col++)
+        int width = SAMPLE_SIZES[size][0];
+        int height = SAMPLE_SIZES[size][1];
+        vector<vector<Pixel>> image = synthetic_image(width, height);
+        for (int kernel = 0; kernel < KERNEL_COUNT; kernel++)
         {
-            Pixel p= image[row][col];
-            //getting color of each pixel
-            int red =p.red;
-            int green=p.green;
-            int blue = p.blue;
-            // new paramaters
-            int newred;
-            int newblue;
-            int newgreen;
-            // conditions for loops
-            int max_color= max((red),max((green),(blue)));
-            int sum_color = red+green+blue;
-            // if light, make white. 
-            if (sum_color >= 550)
+            function<void()> run;
+            if (kernel == KERNEL_PIXEL)
             {
-                newred =255;
-                newblue = 255;
-                newgreen = 255;
-                newpixel={newred,newgreen,newblue};
-                newimg[row][col]= newpixel;
+                Operation op;
+                op.choice = 2;
+                op.scaling_factor = 0.8;
+                run = [op, &image]() { apply_operation(op, image); };
             }
-            // if dark, make black. 
-            else if (sum_color <=150)
+            else if (kernel == KERNEL_ROTATE)
             {
-                newred =0;
-                newblue=0;
-                newgreen=0;
-                newpixel={newred,newgreen,newblue};
-                newimg[row][col]= newpixel;
+                run = [&]() { proc4(image); };
             }
-            // if red, keep as red.
-            else if (max_color==red)
+            else if (kernel == KERNEL_CONVOLUTION)
             {
-                newred=255;
-                newblue=0;
-                newgreen=0;
-                newpixel={newred,newgreen,newblue};
-                newimg[row][col]= newpixel;
-
+                run = [&]() { proc13(image, 2.0); };
             }
-            // of green, keep as green. 
-            else if (max_color==green)
+            else
             {
-                newred = 0;
-                newgreen =255;
-                newblue = 0;
-                newpixel={newred,newgreen,newblue};
-                newimg[row][col]= newpixel;
+                run = [&]() { resample_image(image, width / 2, height / 2, RESAMPLE_BILINEAR); };
             }
-            // if blue, keep blue.
-            else 
+
+            KernelConfig& config = kernel_tuning[kernel][size];
+            KernelConfig best = config;
+            double best_time = 0;
+            for (const KernelConfig& candidate : tuning_candidates(kernel))
             {
-                newred=0;
-                newblue=255;
-                newgreen=0;
-                newpixel={newred,newgreen,newblue};
-                newimg[row][col]= newpixel;
+                config = candidate;
+                double seconds = time_kernel(run);
+                if (best_time == 0 || seconds < best_time)
+                {
+                    best = candidate;
+                    best_time = seconds;
+                }
             }
-
-
+            config = best;
+            cout << KERNEL_NAMES[kernel] << " " << SIZE_NAMES[size] << " (" << width << "x" << height << "): "
+                 << best.threads << " threads, variant " << best.variant << ", blocks " << best.block_width
+                 << "x" << best.block_height << ", " << best_time * 1000 << " ms" << endl;
         }
     }
-
-    return newimg;
+    if (!save_profile(filename))
+    {
+        cout << "Error: could not save " << filename << endl;
+        return false;
+    }
+    cout << "Successfully saved " << filename << endl;
+    return true;
 }
 
+// Number of filters in the menu
+const int MENU_CHOICES = 15;
 
 /*
     Function that applies an image filter based on user choice
@@ -699,50 +4646,44 @@ vector<vector<Pixel>> proc10 (string filename)
 
 void applyFilter(int choice, const string& filename) {
     // forward decliration of varibales in the switch cases
-    vector<vector<Pixel>> newimage;
+    Operation op;
+    op.choice = choice;
     string output_filename;
-    double scaling_factor;
-    int rotation_number;
-    int x_scale;
-    int y_scale;
-    // switch to assign a function based on user input
+    int thumbnail_size;
+    // switch to read the parameters of the filter from the user
     switch (choice) {
         case 1:
-            newimage= proc1(filename);
+        case 3:
+        case 4:
+        case 7:
+        case 10:
+        case 15:
             break;
         case 2:
             cout << "Please select a scaling factor (between 0 and 1)";
             // check to verify valid user input
-            while (!(cin >> scaling_factor) || scaling_factor>1.0 || scaling_factor<0.0 )
+            while (!(cin >> op.scaling_factor) || op.scaling_factor>1.0 || op.scaling_factor<0.0 )
             {   
                 cin.clear();
                 cin.ignore();
                 cout << "Error: please select a scaling factor between 0 and 1: ";
             }
-            newimage= proc2(filename,scaling_factor);
-            break;
-        case 3:
-            newimage = proc3(filename);
-            break;
-        case 4:
-            newimage= proc4(filename);
             break;
         case 5:
             cout << "Please insert amount of times you would like to rotate the image by 90 degrees: ";
             // check to verify valid user input
-            while(!(cin >> rotation_number))
+            while(!(cin >> op.rotation_number))
             {
                 cin.clear();
                 cin.ignore();
                
                 cout << "Error: please select a whole number for rotation: ";
             }
-            newimage = proc5(filename,rotation_number);
             break;
         case 6:
             cout <<"Please enter a scale you would like to enalrge the height by (must be a whole nuber greater than 0): ";
             // check to verify valid user input
-            while(!(cin >> y_scale) || y_scale<=0)
+            while(!(cin >> op.y_scale) || op.y_scale<=0)
             {
                 cin.clear();
                 cin.ignore();
@@ -751,75 +4692,114 @@ void applyFilter(int choice, const string& filename) {
             }
             cout <<"Please enter a scale you would like to enalrge the width by (must be a whole nuber greater than 0): ";
             // check to verify valid user input
-            while(!(cin >> x_scale) || x_scale<=0)
+            while(!(cin >> op.x_scale) || op.x_scale<=0)
             {
                 cin.clear();
                 cin.ignore();
                 cout << "Error: please select a whole number for scalling: ";
             }
-            newimage = proc6(filename,x_scale,y_scale);
         break;
-        case 7:
-            newimage = proc7(filename);            
-            break;
         case 8:
-
+        case 9:
             cout << "Please select a scaling factor (between 0 and 1): ";
             // check to verify valid user input
-            while (!(cin >> scaling_factor) || scaling_factor>1.0 || scaling_factor<0.0 )
+            while (!(cin >> op.scaling_factor) || op.scaling_factor>1.0 || op.scaling_factor<0.0 )
             {   
                 cin.clear();
                 cin.ignore();
                 cout << "Error: please select a scaling factor between 0 and 1: ";
             }
-            newimage = proc8(filename,scaling_factor);
-
             break;
-        case 9:
-            cout << "Please select a scaling factor (between 0 and 1): ";
+        case 11:
+        case 12:
+            cout << "Please select a resampling filter (1 = box, 2 = bilinear, 3 = lanczos): ";
             // check to verify valid user input
-            while (!(cin >> scaling_factor) || scaling_factor>1.0 || scaling_factor<0.0 )
-            {   
+            while(!(cin >> op.method) || op.method < RESAMPLE_BOX || op.method > RESAMPLE_LANCZOS)
+            {
                 cin.clear();
                 cin.ignore();
-                cout << "Error: please select a scaling factor between 0 and 1: ";
+                cout << "Error: please select 1, 2 or 3: ";
+            }
+            if (choice == 12)
+            {
+                cout << "Please enter the thumbnail sizes in pixels (longest side), then 0 to finish: ";
+                // check to verify valid user input
+                while(!(cin >> thumbnail_size) || thumbnail_size != 0 || op.thumbnail_sizes.empty())
+                {
+                    if (!cin)
+                    {
+                        cin.clear();
+                        cin.ignore();
+                        cout << "Error: please enter whole numbers greater than 0: ";
+                    }
+                    else if (thumbnail_size > 0)
+                    {
+                        op.thumbnail_sizes.push_back(thumbnail_size);
+                    }
+                    else
+                    {
+                        cout << "Error: please enter at least one size greater than 0: ";
+                    }
+                }
+                break;
+            }
+            cout << "Please enter the new width in pixels (must be a whole number greater than 0): ";
+            // check to verify valid user input
+            while(!(cin >> op.new_width) || op.new_width<=0)
+            {
+                cin.clear();
+                cin.ignore();
+                cout << "Error: please select a whole number greater than 0: ";
+            }
+            cout << "Please enter the new height in pixels (must be a whole number greater than 0): ";
+            // check to verify valid user input
+            while(!(cin >> op.new_height) || op.new_height<=0)
+            {
+                cin.clear();
+                cin.ignore();
+                cout << "Error: please select a whole number greater than 0: ";
             }
-            newimage = proc9(filename,scaling_factor);
-            
             break;
-        case 10:
-            newimage=proc10(filename);
+        case 13:
+            cout << "Please enter the blur radius in pixels (between 1 and 50): ";
+            // check to verify valid user input
+            while (!(cin >> op.radius) || op.radius<1.0 || op.radius>50.0)
+            {
+                cin.clear();
+                cin.ignore();
+                cout << "Error: please select a blur radius between 1 and 50: ";
+            }
+            break;
+        case 14:
+            cout << "Please select a sharpening amount (between 0 and 5): ";
+            // check to verify valid user input
+            while (!(cin >> op.amount) || op.amount<0.0 || op.amount>5.0)
+            {
+                cin.clear();
+                cin.ignore();
+                cout << "Error: please select a sharpening amount between 0 and 5: ";
+            }
             break;
         default:
         // check to verify valid user input
             cout << "Invalid choice. This should never happen." << endl;
-            break;
+            return;
     }
-    // loop that assigns a new filename for the new image if the input is valid.
-    // and saves the new image. 
-    for (int i =1; i<11;i++)
+    // assigns a new filename for the new image and runs the filter.
+    cout << "Enter a image name for the new image (dont provide the extension or path): ";
+    cin >>output_filename;
+    const char* file = filename.c_str();
+    int len = strlen(file);
+    // loop that inserts the new file name before the .bmp extension 
+    for (int i = len -1; i>=0; i--)
     {
-        if (choice == i)
+        if (file[i] == '.')
         {
-            cout << "Enter a image name for the new image (dont provide the extension or path): ";
-            cin >>output_filename;
-            const char* file = filename.c_str();
-            int len = strlen(file);
-            // loop that inserts the new file name before the .bmp extension 
-            for (int i = len -1; i>=0; i--)
-            {
-                if (file[i] == '.')
-                {
-                    string str_num = to_string(i);
-                    output_filename = filename.substr(0,i)+ +"_"+output_filename+ ".bmp";
-                    break;
-                }
-            }
-            // writes a new image with the userinput. 
-            write_image(output_filename, newimage);
-            cout << "Successfully saved " + output_filename<<endl;
+            output_filename = filename.substr(0,i)+ +"_"+output_filename+ ".bmp";
+            break;
         }
     }
+    run_job(op, filename, output_filename);
 }
 /*
     Function that asks for user input
@@ -836,7 +4816,7 @@ void User_interface() {
     while (true) {
         cout << "Please select the filter you would like to apply to your image (must be a bmp file) or Q to quit" << endl;
         cout << "Image Processing Menu" << endl;
-        cout << "1. Vignette\n2. Clarendon\n3. Grayscale\n4. Rotate 90 degrees\n5. Rotate multiple 90 degrees\n6. Enlarge\n7. High Contrast\n8. Lighten\n9. Darken\n10. Black, white, red, green, blue\n";
+        cout << "1. Vignette\n2. Clarendon\n3. Grayscale\n4. Rotate 90 degrees\n5. Rotate multiple 90 degrees\n6. Enlarge\n7. High Contrast\n8. Lighten\n9. Darken\n10. Black, white, red, green, blue\n11. Resize\n12. Thumbnails\n13. Blur\n14. Sharpen\n15. Edge detect\n";
         cout << "Q. Quit" << endl;
         cout << "Enter your choice: ";
         cin >> choice;
@@ -857,7 +4837,7 @@ void User_interface() {
         }
 
         // if user puts and invalid integer, it reprompts for input
-        if (choiceInt < 1 || choiceInt > 10) {
+        if (choiceInt < 1 || choiceInt > MENU_CHOICES) {
             cout << "Choice out of range. Please enter a valid option from the menu." << endl;
             continue;
         }
@@ -870,16 +4850,14 @@ void User_interface() {
         {
             const char* file = filename.c_str();
             int len = strlen(file);
-            if (file[len-1]== 'p'&& file[len-2]== 'm' && file[len-3] == 'b' )
+            if (len >= 3 && file[len-1]== 'p'&& file[len-2]== 'm' && file[len-3] == 'b' )
             {
-                try {
-                    vector<vector<Pixel>> orginal_image_check = read_image(filename);
+                // only the header is checked here, applyFilter decodes the pixels
+                if (probe_image(filename).valid)
+                {
                     break;
-                } catch (invalid_argument&) {
-                    cout << "Invalid choice. Please enter a valid file path: " << endl;
-                    continue;
                 }
-                break;
+                cout << "Invalid choice. Please enter a valid file path: " << endl;
             }
             else
             {
@@ -912,9 +4890,149 @@ void User_interface() {
 }
 
 
-int main()
+int main(int argc, char* argv[])
 {
     //string file_test="/Users/faisalshahin/Downloads/final/sample_images/sample.bmp";
+    // options that apply to every job
+    const char* program = argv[0];
+    int arg = 1;
+    while (arg < argc)
+    {
+        if (arg + 1 < argc && string(argv[arg]) == "--memory-budget")
+        {
+            char* end = nullptr;
+            long long budget = strtoll(argv[arg + 1], &end, 10);
+            if (end == argv[arg + 1] || *end != '\0' || budget <= 0 || budget > numeric_limits<long long>::max() / (1024 * 1024))
+            {
+                cout << "Error: the memory budget must be a positive number of megabytes, not " << argv[arg + 1] << endl;
+                return 1;
+            }
+            memory_budget = budget * 1024 * 1024;
+            arg += 2;
+        }
+        else if (string(argv[arg]) == "--rle")
+        {
+            use_rle = true;
+            arg++;
+        }
+        else if (arg + 4 < argc && string(argv[arg]) == "--roi")
+        {
+            // x y width height, the size has to be positive
+            int values[4];
+            for (int i = 0; i < 4; i++)
+            {
+                const char* text = argv[arg + 1 + i];
+                char* end = nullptr;
+                long value = strtol(text, &end, 10);
+                if (end == text || *end != '\0' || value < (i < 2 ? numeric_limits<int>::min() : 1) || value > numeric_limits<int>::max())
+                {
+                    cout << "Error: the region must be x y width height in pixels with a positive size, not " << text << endl;
+                    return 1;
+                }
+                values[i] = value;
+            }
+            roi = {values[0], values[1], values[2], values[3]};
+            arg += 5;
+        }
+        else if (string(argv[arg]) == "--roi-patch")
+        {
+            roi_patch = true;
+            arg++;
+        }
+        else if (string(argv[arg]) == "--dry-run")
+        {
+            dry_run = true;
+            arg++;
+        }
+        else if (arg + 1 < argc && string(argv[arg]) == "--profile")
+        {
+            profile_path = argv[arg + 1];
+            arg += 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+    argc -= arg - 1;
+    argv += arg - 1;
+
+    // kernel settings tuned for this machine, if --tune has been run
+    if (argc >= 2 && string(argv[1]) == "--tune")
+    {
+        return run_autotune(profile_path) ? 0 : 1;
+    }
+    load_profile(profile_path);
+
+    // command line modes run without the menu
+    if (argc >= 2 && string(argv[1]) == "--pipe")
+    {
+        vector<Operation> ops;
+        if (argc != 3)
+        {
+            cerr << "Usage: " << program << " --pipe <filter chain> < frames.bmp > filtered.bmp" << endl;
+            return 1;
+        }
+        if (roi.width > 0 || roi.height > 0 || roi_patch || use_rle || memory_budget > 0)
+        {
+            cerr << "Error: --roi, --roi-patch, --rle and --memory-budget do not apply to --pipe" << endl;
+            return 1;
+        }
+        // stdout carries the frames, so messages go to stderr
+        if (!parse_operations(argv[2], ops, cerr))
+        {
+            return 1;
+        }
+        vector<Operation> plan = optimize_plan(ops);
+        print_plan(ops, plan, cerr);
+        return run_pipe(plan) < 0 ? 1 : 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--run")
+    {
+        vector<Operation> ops;
+        if (argc != 5 && !(dry_run && argc == 3))
+        {
+            cout << "Usage: " << program << " [--dry-run] --run <filter chain> <input.bmp|raw> <output.bmp|raw>" << endl;
+            return 1;
+        }
+        if (roi.width > 0 || roi.height > 0 || roi_patch)
+        {
+            cout << "Error: --roi and --roi-patch apply to the menu, not to --run" << endl;
+            return 1;
+        }
+        if (!parse_operations(argv[2], ops))
+        {
+            return 1;
+        }
+        return run_plan(ops, argc == 5 ? argv[3] : "", argc == 5 ? argv[4] : "") ? 0 : 1;
+    }
+    if (argc >= 2 && string(argv[1]) == "--index")
+    {
+        if (argc != 4)
+        {
+            cout << "Usage: " << program << " --index <directory> <index.csv>" << endl;
+            return 1;
+        }
+        int count = index_directory(argv[2], argv[3]);
+        if (count < 0)
+        {
+            return 1;
+        }
+        cout << "Indexed " << count << " images into " << argv[3] << endl;
+        return 0;
+    }
+    if (argc >= 2 && (string(argv[1]) == "--to-raw" || string(argv[1]) == "--to-bmp"))
+    {
+        bool to_raw = string(argv[1]) == "--to-raw";
+        if (argc != 4)
+        {
+            cout << "Usage: " << program << (to_raw ? " --to-raw <input.bmp> <output.raw>" : " --to-bmp <input.raw> <output.bmp>") << endl;
+            return 1;
+        }
+        bool saved = to_raw ? bmp_to_raw(argv[2], argv[3]) : raw_to_bmp(argv[2], argv[3]);
+        cout << (saved ? "Successfully saved " : "Error: could not convert ") << argv[3] << endl;
+        return saved ? 0 : 1;
+    }
     User_interface();
     return 0;
 }
\ No newline at end of file